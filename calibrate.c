@@ -0,0 +1,138 @@
+#include <stddef.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <avr/eeprom.h>
+
+#include "globals.h"
+#include "calibrate.h"
+
+// Maps averaged AD8495 readings to temperature. The default table is the
+// K-type curve as the AD8495 sees it with its cold junction at 25C, read
+// against a 5.000V reference at 10 bits, so it already accounts for the
+// thermocouple bending away from 5mV/C at high temperature. Up to
+// CAL_USER_POINTS measured (reading, actual) pairs from EEPROM correct it:
+// the error at each point is interpolated between points and extended past
+// the outer ones, so a single point is an offset and two are an offset and
+// gain. The corrected curve is resampled onto the even grid once, so the
+// per-sample cost doesn't depend on how it was calibrated.
+
+static const int16_t cal_default[CAL_SEGMENTS+1] PROGMEM = {
+	TEMP_FX(0.0), TEMP_FX(31.3), TEMP_FX(62.3), TEMP_FX(93.1),
+	TEMP_FX(124.0), TEMP_FX(155.6), TEMP_FX(187.5), TEMP_FX(219.4),
+	TEMP_FX(250.9), TEMP_FX(282.1), TEMP_FX(312.9), TEMP_FX(343.5),
+	TEMP_FX(373.9), TEMP_FX(404.2), TEMP_FX(434.3), TEMP_FX(464.4),
+	TEMP_FX(494.4), TEMP_FX(524.3), TEMP_FX(554.2), TEMP_FX(584.2),
+	TEMP_FX(614.2), TEMP_FX(644.4), TEMP_FX(674.6), TEMP_FX(705.0),
+	TEMP_FX(735.6), TEMP_FX(766.4), TEMP_FX(797.4), TEMP_FX(828.6),
+	TEMP_FX(860.1), TEMP_FX(891.8), TEMP_FX(923.8), TEMP_FX(956.0),
+	TEMP_FX(988.6)
+};
+
+static volatile int16_t grid[CAL_SEGMENTS+1];
+static caltable_t user;
+
+static uint8_t cal_sum(const caltable_t *t) {
+	const uint8_t *b = (const uint8_t*)t;
+	uint8_t sum = 0;
+	for(uint8_t i=0; i<offsetof(caltable_t, check); i++)
+		sum += b[i];
+	return ~sum;
+}
+
+static int16_t default_temp(uint16_t adc) {
+	uint8_t i = adc>>CAL_STEP_BITS;
+	if(i>=CAL_SEGMENTS) return pgm_read_word(&cal_default[CAL_SEGMENTS]);
+	int16_t lo = pgm_read_word(&cal_default[i]);
+	int16_t hi = pgm_read_word(&cal_default[i+1]);
+	uint16_t frac = adc&((1<<CAL_STEP_BITS)-1);
+	return lo+(int16_t)(((int32_t)(hi-lo)*frac)>>CAL_STEP_BITS);
+}
+
+// Rebuild the lookup grid from the default table and the user points
+static void cal_build(void) {
+	calpoint_t p[CAL_USER_POINTS];
+	int16_t err[CAL_USER_POINTS];
+	uint8_t n = 0;
+	
+	// Sorted by reading, with each point's error against the default curve
+	for(uint8_t i=0; i<CAL_USER_POINTS; i++) {
+		if(user.point[i].adc==CAL_UNUSED) continue;
+		uint8_t j = n++;
+		for(; j && p[j-1].adc>user.point[i].adc; j--) {
+			p[j] = p[j-1];
+			err[j] = err[j-1];
+		}
+		p[j] = user.point[i];
+		err[j] = p[j].temp-default_temp(p[j].adc);
+	}
+	
+	int16_t prev = INT16_MIN;
+	for(uint8_t i=0; i<=CAL_SEGMENTS; i++) {
+		uint16_t adc = (uint16_t)i<<CAL_STEP_BITS;
+		int32_t t = pgm_read_word(&cal_default[i]);
+		if(n==1) {
+			t += err[0];
+		} else if(n>1) {
+			uint8_t k = 0;
+			while(k<n-2 && adc>p[k+1].adc) k++;
+			t += err[k]+((int32_t)(err[k+1]-err[k])*((int32_t)adc-p[k].adc))/
+									(p[k+1].adc-p[k].adc);
+		}
+		// Keep it in range and rising, whatever the points said; anything
+		// below zero reads as a thermocouple error anyway
+		if(t<prev)					t = prev;
+		if(t>TEMP_FX_MAX)		t = TEMP_FX_MAX;
+		uint8_t sreg = SREG;
+		cli();
+		grid[i] = t;
+		SREG = sreg;
+		prev = t;
+	}
+}
+
+void cal_load(void *base) {
+	eeprom_read_block(&user, base, sizeof(caltable_t));
+	if(user.check!=cal_sum(&user)) {
+		// Never calibrated, or the table was damaged
+		for(uint8_t i=0; i<CAL_USER_POINTS; i++)
+			user.point[i].adc = CAL_UNUSED;
+	}
+	cal_build();
+}
+
+// Record the actual temperature for the current reading as one of the
+// calibration points, refusing one too close to another to give a gain
+bool cal_capture(void *base, uint8_t slot, uint16_t adc, int16_t temp) {
+	for(uint8_t i=0; i<CAL_USER_POINTS; i++) {
+		if(i==slot || user.point[i].adc==CAL_UNUSED) continue;
+		uint16_t span = (adc>user.point[i].adc)?adc-user.point[i].adc:user.point[i].adc-adc;
+		if(span<CAL_MIN_SPAN) return false;
+	}
+	user.point[slot].adc = adc;
+	user.point[slot].temp = temp;
+	user.check = cal_sum(&user);
+	eeprom_update_block(&user, base, sizeof(caltable_t));
+	cal_build();
+	return true;
+}
+
+// Go back to the default curve
+void cal_reset(void *base) {
+	for(uint8_t i=0; i<CAL_USER_POINTS; i++)
+		user.point[i].adc = CAL_UNUSED;
+	user.check = cal_sum(&user);
+	eeprom_update_block(&user, base, sizeof(caltable_t));
+	cal_build();
+}
+
+// Temperature for a Q4 reading; called for every sample, so only a lookup
+// and a lerp between the grid points either side
+int16_t cal_lookup(uint16_t adc) {
+	uint8_t i = adc>>CAL_STEP_BITS;
+	if(i>=CAL_SEGMENTS) return grid[CAL_SEGMENTS];
+	int16_t lo = grid[i];
+	uint16_t rise = grid[i+1]-lo;
+	uint16_t frac = adc&((1<<CAL_STEP_BITS)-1);
+	return lo+(int16_t)(((uint32_t)rise*frac)>>CAL_STEP_BITS);
+}
@@ -0,0 +1,35 @@
+#ifndef CALIBRATE_H
+#define CALIBRATE_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+/* Thermocouple calibration. Readings are averaged 10-bit ADC counts in Q4
+ * (1/16ths of a count), and map to fixed-point degrees through a table spaced
+ * evenly in counts so a lookup is a shift, a mask and one multiply. */
+#define CAL_IN_BITS					14			// Q4 10-bit readings
+#define CAL_SEG_BITS				5				// 32 segments across the range
+#define CAL_SEGMENTS				(1<<CAL_SEG_BITS)
+#define CAL_STEP_BITS				(CAL_IN_BITS-CAL_SEG_BITS)
+#define CAL_USER_POINTS			4				// Calibration points kept in EEPROM
+#define CAL_UNUSED					0xFFFF	// Reading of an empty calibration point
+#define CAL_MIN_SPAN				(16<<4)	// Closest two points may be, Q4 counts
+#define CAL_LOW							0				// Points set by the two-point routine
+#define CAL_HIGH						1
+
+typedef struct {
+	uint16_t adc;					// Reading, Q4 counts, CAL_UNUSED when empty
+	int16_t temp;					// Actual temperature, fixed-point degrees
+} calpoint_t;
+
+typedef struct {
+	calpoint_t point[CAL_USER_POINTS];
+	uint8_t check;				// Inverted byte sum of the points
+} caltable_t;
+
+void cal_load(void *base);
+bool cal_capture(void *base, uint8_t slot, uint16_t adc, int16_t temp);
+void cal_reset(void *base);
+int16_t cal_lookup(uint16_t adc);
+
+#endif // CALIBRATE_H
@@ -0,0 +1,65 @@
+#include <stddef.h>
+#include <avr/eeprom.h>
+
+#include "checkpoint.h"
+
+// Run checkpoints in EEPROM. Each checkpoint goes to the next of
+// CHECKPOINT_SLOTS slots with a sequence number one higher than the last,
+// so the wear is spread over all of them; the current one is the slot
+// whose successor doesn't continue the sequence. A checksum guards against
+// a slot that was only half written when the power went.
+
+static uint8_t current = 0;		// Slot of the newest checkpoint
+static uint8_t seq = 0;
+static bool valid = false;		// Whether the newest checkpoint holds a run
+
+static uint8_t checkpoint_sum(const checkpoint_t *cp) {
+	const uint8_t *b = (const uint8_t*)cp;
+	uint8_t sum = 0;
+	for(uint8_t i=0; i<offsetof(checkpoint_t, check); i++)
+		sum += b[i];
+	return ~sum;
+}
+
+bool checkpoint_load(void *base, checkpoint_t *cp) {
+	checkpoint_t *slots = base;
+	uint8_t s[CHECKPOINT_SLOTS];
+	for(uint8_t i=0; i<CHECKPOINT_SLOTS; i++)
+		s[i] = eeprom_read_byte(&slots[i].seq);
+	current = CHECKPOINT_SLOTS-1;
+	for(uint8_t i=0; i<CHECKPOINT_SLOTS; i++) {
+		if(s[(i+1)%CHECKPOINT_SLOTS]!=(uint8_t)(s[i]+1)) {
+			current = i;
+			break;
+		}
+	}
+	seq = s[current];
+	eeprom_read_block(cp, &slots[current], sizeof(checkpoint_t));
+	if(cp->check!=checkpoint_sum(cp)) {
+		// Torn write: the one before it is the last good checkpoint
+		uint8_t prev = current?current-1:CHECKPOINT_SLOTS-1;
+		eeprom_read_block(cp, &slots[prev], sizeof(checkpoint_t));
+		if(cp->check!=checkpoint_sum(cp)) cp->profile = CHECKPOINT_NONE;
+	}
+	valid = (cp->profile!=CHECKPOINT_NONE);
+	return valid;
+}
+
+void checkpoint_save(void *base, checkpoint_t *cp) {
+	checkpoint_t *slots = base;
+	if(++current>=CHECKPOINT_SLOTS) current = 0;
+	cp->seq = ++seq;
+	cp->check = checkpoint_sum(cp);
+	eeprom_update_block(cp, &slots[current], sizeof(checkpoint_t));
+	valid = (cp->profile!=CHECKPOINT_NONE);
+}
+
+// Mark that no run is in progress, only writing if one was
+void checkpoint_clear(void *base) {
+	if(!valid) return;
+	checkpoint_t cp;
+	for(uint8_t i=0; i<sizeof(checkpoint_t); i++)
+		((uint8_t*)&cp)[i] = 0;
+	cp.profile = CHECKPOINT_NONE;
+	checkpoint_save(base, &cp);
+}
@@ -0,0 +1,31 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+/* Run checkpoint settings */
+#define CHECKPOINT_SLOTS			4				// Slots written in turn to spread the wear
+#define CHECKPOINT_SECS				10			// Seconds between checkpoints within a segment
+#define CHECKPOINT_MAX_DROP		30			// Resume only if the oven has lost less than this
+#define CHECKPOINT_NONE				0xFF		// Profile ID of a cleared checkpoint
+
+typedef struct {
+	uint8_t seq;					// Sequence number, the newest slot is current
+	uint8_t profile;			// Profile ID, CHECKPOINT_NONE when no run is in progress
+	uint8_t index;				// Segment
+	uint16_t elapsed;			// Time into the segment, tenths of a second
+	uint16_t tal;					// Time above liquidus so far, tenths of a second
+	int16_t peak;					// Peak so far, fixed-point degrees
+	int16_t temp;					// Temperature when written, fixed-point degrees
+	uint16_t load_scale;	// Thermal load scale, Q8
+	uint8_t batchrun;			// Batch progress, both zero outside a batch
+	uint8_t batchcount;
+	uint8_t check;				// Inverted byte sum of the above
+} checkpoint_t;
+
+bool checkpoint_load(void *base, checkpoint_t *cp);
+void checkpoint_save(void *base, checkpoint_t *cp);
+void checkpoint_clear(void *base);
+
+#endif // CHECKPOINT_H
@@ -0,0 +1,45 @@
+#include "globals.h"
+#include "cooling.h"
+
+// Closed-loop cooling. While the profile ramps down, a fan is driven to keep
+// the oven on the ramp-down setpoint; once the profile is over, the setpoint
+// carries on down at COOLING_RATE. The heater and the fan never work against
+// each other, as the fan is only run while the heater demand is zero. If the
+// oven cools faster than the paste allows, the fan is backed off whatever
+// the error.
+
+void cool_init(cooler_t *c, uint16_t dt_ms) {
+	c->dt_ms = dt_ms;
+	cool_reset(c, 0);
+}
+
+void cool_reset(cooler_t *c, int16_t measured) {
+	c->sp = (int32_t)measured<<8;
+	c->isum = 0;
+}
+
+uint8_t cool_update(cooler_t *c, int16_t setpoint, int16_t measured, int16_t slope) {
+	if(setpoint!=COOL_NO_SETPOINT) {
+		c->sp = (int32_t)setpoint<<8;
+	} else {
+		c->sp -= ((int32_t)TEMP_FX(COOLING_RATE)*256*c->dt_ms)/1000;
+		if(c->sp<0) c->sp = 0;
+	}
+	
+	// Positive error means the oven is hotter than it should be
+	int32_t e = measured-(c->sp>>8);
+	if(slope<-TEMP_FX(COOLING_MAX_RATE)) {
+		c->isum -= c->isum>>3;
+		return 0;
+	}
+	
+	int32_t p = ((int32_t)COOLING_KP*e)>>TEMP_FRAC_BITS;
+	c->isum += ((int32_t)COOLING_KI*e*256*c->dt_ms/1000)>>TEMP_FRAC_BITS;
+	if(c->isum<0)				c->isum = 0;
+	if(c->isum>255L<<8)	c->isum = 255L<<8;
+	
+	int32_t u = p+(c->isum>>8);
+	if(u<COOLING_MIN_DUTY)	return 0;
+	if(u>255)								return 255;
+	return u;
+}
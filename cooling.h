@@ -0,0 +1,27 @@
+#ifndef COOLING_H
+#define COOLING_H
+
+#include <inttypes.h>
+
+/* Cooling actuator settings */
+#define COOLING_FAN					1				// Drive a cooling fan from OC2A (PB3)
+#define COOLING_RATE				3				// Cooling rate to follow after the profile, degrees/s
+#define COOLING_MAX_RATE		4				// Back off if cooling faster than this, degrees/s
+#define COOLING_SAFE_TEMP		60			// Door may be opened below this temperature
+#define COOLING_KP					16			// Duty per degree above the setpoint
+#define COOLING_KI					2				// Duty per degree-second above the setpoint
+#define COOLING_MIN_DUTY		64			// Below this the fan stalls, so it's left off
+
+#define COOL_NO_SETPOINT		INT16_MIN	// Carry on down at COOLING_RATE
+
+typedef struct {
+	int32_t sp;					// Cooling setpoint, Q8 fixed-point degrees
+	int32_t isum;				// Integral, Q8 duty
+	uint16_t dt_ms;
+} cooler_t;
+
+void cool_init(cooler_t *c, uint16_t dt_ms);
+void cool_reset(cooler_t *c, int16_t measured);
+uint8_t cool_update(cooler_t *c, int16_t setpoint, int16_t measured, int16_t slope);
+
+#endif // COOLING_H
@@ -0,0 +1,49 @@
+#include "globals.h"
+#include "pid.h"
+#include "power.h"
+#include "energy.h"
+
+// Heater energy accounting for a run. The tick hands over the mask of heater
+// channels the power stage actually switched on, so the on-time counted is
+// what the elements got rather than what the controller asked for. Energy
+// follows from the on-time and the rated power of each channel.
+
+void energy_reset(energy_t *e) {
+	for(uint8_t i=0; i<STAGE_COUNT; i++)
+		e->on_ms[i] = e->stage_ms[i] = 0;
+	e->peak_duty = 0;
+}
+
+// Called from the tick, so kept to a couple of additions
+void energy_tick(energy_t *e, uint8_t stage, uint8_t heat, uint8_t tick_ms) {
+	if(stage>=STAGE_COUNT) return;
+	e->stage_ms[stage] += tick_ms;
+	for(; heat; heat>>=1)
+		if(heat&1) e->on_ms[stage] += tick_ms;
+}
+
+void energy_demand(energy_t *e, uint16_t demand) {
+	if(demand>e->peak_duty) e->peak_duty = demand;
+}
+
+// Energy used over the whole run, in tenths of a watt-hour
+uint16_t energy_total(const energy_t *e) {
+	uint32_t ms = 0;
+	for(uint8_t i=0; i<STAGE_COUNT; i++)
+		ms += e->on_ms[i];
+	return ((ms/100)*ENERGY_CHANNEL_WATTS)/3600UL;
+}
+
+// Average duty over all channels through a stage, per-mille
+uint16_t energy_duty(const energy_t *e, uint8_t stage) {
+	if(stage>=STAGE_COUNT || !e->stage_ms[stage]) return 0;
+	return (e->on_ms[stage]*POWER_MAX)/(e->stage_ms[stage]*POWER_CHANNELS);
+}
+
+void energy_record(const energy_t *e, runrecord_t *r) {
+	r->energy = energy_total(e);
+	r->peak_duty = e->peak_duty;
+	r->soak_duty = energy_duty(e, STAGE_SOAK);
+	for(uint8_t i=0; i<STAGE_COUNT; i++)
+		r->on_secs[i] = e->on_ms[i]/1000;
+}
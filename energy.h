@@ -0,0 +1,35 @@
+#ifndef ENERGY_H
+#define ENERGY_H
+
+#include <inttypes.h>
+
+#include "profile.h"
+
+/* Heater energy accounting */
+#define ENERGY_CHANNEL_WATTS	800			// Rated power of each heater channel
+
+typedef struct {
+	uint32_t on_ms[STAGE_COUNT];		// Heater on-time in each stage, summed over channels
+	uint32_t stage_ms[STAGE_COUNT];	// Time spent in each stage
+	uint16_t peak_duty;							// Highest demand, per-mille
+} energy_t;
+
+// Summary of the last completed run, as stored in EEPROM
+typedef struct {
+	uint8_t profile;
+	uint16_t tal;										// Time above liquidus, seconds
+	int16_t peak;										// Peak temperature, fixed-point degrees
+	uint16_t energy;								// Heater energy, tenths of a watt-hour
+	uint16_t peak_duty;							// Per-mille
+	uint16_t soak_duty;							// Per-mille
+	uint16_t on_secs[STAGE_COUNT];	// Heater on-time in each stage
+} runrecord_t;
+
+void energy_reset(energy_t *e);
+void energy_tick(energy_t *e, uint8_t stage, uint8_t heat, uint8_t tick_ms);
+void energy_demand(energy_t *e, uint16_t demand);
+uint16_t energy_total(const energy_t *e);
+uint16_t energy_duty(const energy_t *e, uint8_t stage);
+void energy_record(const energy_t *e, runrecord_t *r);
+
+#endif // ENERGY_H
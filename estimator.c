@@ -0,0 +1,58 @@
+#include "globals.h"
+#include "pid.h"
+#include "estimator.h"
+
+// Thermocouple lag compensation. An alpha-beta tracker follows the lagging
+// thermocouple reading and its rate; when an oven model is available, the
+// heater demand is used to predict how that rate will change. The true
+// temperature is then recovered by inverting the sensor's first-order lag:
+// T = Tm + tau_s * dTm/dt.
+
+void est_init(estimator_t *est, uint16_t dt_ms) {
+	est->dt_ms = dt_ms;
+	est->sensor_steps = EST_SENSOR_TAU_MS/dt_ms;
+	if(!est->sensor_steps) est->sensor_steps = 1;
+	est_reset(est, 0);
+}
+
+// Treat the measurement filter's group delay as more sensor lag
+void est_set_delay(estimator_t *est, uint16_t delay_ms) {
+	est->sensor_steps = (EST_SENSOR_TAU_MS+delay_ms)/est->dt_ms;
+	if(!est->sensor_steps) est->sensor_steps = 1;
+}
+
+void est_reset(estimator_t *est, int16_t measured) {
+	est->tm = est->tprev = (int32_t)measured<<16;
+	est->rate = est->tslope = 0;
+	est->temp = measured;
+	est->tempslope = 0;
+}
+
+void est_update(estimator_t *est, int16_t measured, uint16_t demand, const ovenmodel_t *m) {
+	// Predict: the oven model gives the rate the true temperature is heading
+	// for, and the thermocouple's rate follows it through the sensor lag
+	est->tm += est->rate;
+	if(m) {
+		int32_t that = (est->tm>>16)+((est->rate*est->sensor_steps)>>16);
+		int32_t drive = ((int32_t)m->gain<<TEMP_FRAC_BITS)*demand/POWER_MAX-(that-m->ambient);
+		if(drive>INT16_MAX)		drive = INT16_MAX;
+		if(drive<-INT16_MAX)	drive = -INT16_MAX;
+		uint32_t tau_steps = (uint32_t)m->tau*1000/est->dt_ms;
+		if(tau_steps) {
+			int32_t tdot = (drive<<16)/(int32_t)tau_steps;
+			est->rate += (tdot-est->rate)/est->sensor_steps;
+		}
+	}
+	
+	// Correct against the actual reading
+	int32_t e = ((int32_t)measured<<16)-est->tm;
+	est->tm += e>>EST_ALPHA_SHIFT;
+	est->rate += e>>EST_BETA_SHIFT;
+	
+	// Undo the sensor lag and publish the estimate
+	int32_t t = est->tm+est->rate*est->sensor_steps;
+	est->tslope += ((t-est->tprev)-est->tslope)>>EST_RATE_SHIFT;
+	est->tprev = t;
+	est->temp = t>>16;
+	est->tempslope = (est->tslope*(1000/est->dt_ms))>>16;
+}
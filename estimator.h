@@ -0,0 +1,30 @@
+#ifndef ESTIMATOR_H
+#define ESTIMATOR_H
+
+#include <inttypes.h>
+
+#include "model.h"
+
+/* Thermocouple lag compensation settings */
+#define EST_SENSOR_TAU_MS		2500		// Thermocouple time constant
+#define EST_ALPHA_SHIFT			6				// Measurement correction gain, 1/64
+#define EST_BETA_SHIFT			13			// Rate correction gain, about alpha^2/2
+#define EST_RATE_SHIFT			4				// Smoothing on the published rate
+
+typedef struct {
+	int32_t tm;					// Estimated thermocouple reading, Q16 fixed-point degrees
+	int32_t rate;				// Its rate of change, Q16 fixed-point degrees per step
+	int32_t tprev;			// Previous estimated true temperature, Q16
+	int32_t tslope;			// Smoothed true temperature slope, Q16 per step
+	uint16_t dt_ms;
+	uint16_t sensor_steps;
+	int16_t temp;				// Estimated true temperature, fixed-point degrees
+	int16_t tempslope;	// Its rate of change, fixed-point degrees per second
+} estimator_t;
+
+void est_init(estimator_t *est, uint16_t dt_ms);
+void est_reset(estimator_t *est, int16_t measured);
+void est_set_delay(estimator_t *est, uint16_t delay_ms);
+void est_update(estimator_t *est, int16_t measured, uint16_t demand, const ovenmodel_t *m);
+
+#endif // ESTIMATOR_H
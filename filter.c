@@ -0,0 +1,125 @@
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "filter.h"
+
+// Runs each raw reading through the selected stages and returns the result
+// in Q4 counts (1/16ths), as calibration wants. A reading that can't be
+// used, because it was glitched or taken while a heater switched, skips the
+// median and is replaced in the box by the reading at the same point of
+// the last mains cycle, so the box still cancels the pickup. The first
+// reading fills every stage so nothing has to ramp up from zero.
+
+#define FILTER_BOX_SCALE		((16UL<<16)/FILTER_WINDOW)
+
+#define SORT(a,b)						if((b)<(a)) { uint16_t t = (a); (a) = (b); (b) = t; }
+
+static uint16_t median3(const uint16_t *h, uint8_t pos) {
+	uint16_t a = h[pos];
+	uint16_t b = h[pos?pos-1:4];
+	uint16_t c = h[pos>1?pos-2:pos+3];
+	SORT(a, b);
+	if(c<b) b = (c>a)?c:a;
+	return b;
+}
+
+// Six comparisons: the lowest of two sorted pairs can't be the median, so
+// it's swapped for the fifth value, and the lowest after that goes too
+static uint16_t median5(const uint16_t *h) {
+	uint16_t a = h[0], b = h[1], c = h[2], d = h[3];
+	SORT(a, b);
+	SORT(c, d);
+	if(a<c) {
+		a = h[4];
+		SORT(a, b);
+	} else {
+		c = h[4];
+		SORT(c, d);
+	}
+	if(a<c)	return (b<c)?b:c;
+	else		return (a<d)?a:d;
+}
+
+// Output of the box stage, or the latest entry when it's not selected
+static uint16_t box_output(const filter_t *f, uint8_t config, uint8_t latest) {
+	if(config&FILTER_BOX) return ((uint32_t)f->sum*FILTER_BOX_SCALE)>>16;
+	return f->window[latest]<<4;
+}
+
+void filter_init(filter_t *f, uint8_t config) {
+	f->config = config;
+	f->primed = 0;
+}
+
+// Change stages without disturbing the output: the new stages start from
+// where the box is now
+void filter_configure(filter_t *f, uint8_t config) {
+	uint8_t sreg = SREG;
+	cli();
+	if(f->primed) {
+		uint8_t latest = f->slot?f->slot-1:FILTER_WINDOW-1;
+		for(uint8_t i=0; i<5; i++)
+			f->history[i] = f->window[latest];
+		f->iir = (uint32_t)box_output(f, config, latest)<<4;
+	}
+	f->config = config;
+	SREG = sreg;
+}
+
+uint16_t filter_sample(filter_t *f, uint16_t reading, bool usable) {
+	if(!f->primed) {
+		if(!usable) return 0;
+		for(uint8_t i=0; i<5; i++)
+			f->history[i] = reading;
+		for(uint8_t i=0; i<FILTER_WINDOW; i++)
+			f->window[i] = reading;
+		f->pos = f->slot = 0;
+		f->sum = reading*FILTER_WINDOW;
+		f->iir = (uint32_t)reading<<8;
+		f->primed = 1;
+	}
+	
+	uint8_t slot = f->slot;
+	if(++f->slot>=FILTER_WINDOW) f->slot = 0;
+	if(usable) {
+		if(++f->pos>=5) f->pos = 0;
+		f->history[f->pos] = reading;
+		switch(f->config&FILTER_MEDIAN) {
+			case FILTER_MEDIAN_3:
+				reading = median3(f->history, f->pos);
+				break;
+			case FILTER_MEDIAN_5:
+				reading = median5(f->history);
+				break;
+		}
+	} else {
+		reading = f->window[(slot>=FILTER_CYCLE)?slot-FILTER_CYCLE:slot+FILTER_WINDOW-FILTER_CYCLE];
+	}
+	
+	// The box is kept up to date even when it's not selected, so there's
+	// always a reading from the last cycle to stand in
+	f->sum += reading-f->window[slot];
+	f->window[slot] = reading;
+	uint16_t out = box_output(f, f->config, slot);
+	
+	uint8_t shift = (f->config&FILTER_IIR)>>3;
+	if(shift) {
+		f->iir += (((int32_t)out<<4)-(int32_t)f->iir)>>shift;
+		out = f->iir>>4;
+	}
+	return out;
+}
+
+// Group delay of the selected stages, which the lag compensation adds to
+// the thermocouple's own
+uint16_t filter_delay_ms(uint8_t config) {
+	uint16_t half = 0;		// In half samples
+	switch(config&FILTER_MEDIAN) {
+		case FILTER_MEDIAN_3:	half += 2;	break;
+		case FILTER_MEDIAN_5:	half += 4;	break;
+	}
+	if(config&FILTER_BOX) half += FILTER_WINDOW-1;
+	uint8_t shift = (config&FILTER_IIR)>>3;
+	if(shift) half += ((1<<shift)-1)*2;
+	return half*FILTER_SAMPLE_MS/2;
+}
@@ -0,0 +1,57 @@
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#include "power.h"
+
+/* Thermocouple filter chain: an optional median for spikes, the box average
+ * over whole mains periods and an optional single-pole IIR, in that order.
+ * Every stage runs in constant time per sample. */
+#define FILTER_SAMPLE_MS			2				// Sample period the windows are sized for
+
+/* The box window spans a whole number of mains periods (MAINS_HZ is set in
+ * power.h) so pickup at the mains frequency and its harmonics sums to
+ * nothing. FILTER_CYCLE is the shortest whole number of periods. */
+#if MAINS_HZ == 50
+	#define FILTER_CYCLE				10			// One period
+	#define FILTER_WINDOW				20			// Two periods, 40ms
+#elif MAINS_HZ == 60
+	#define FILTER_CYCLE				25			// Three periods
+	#define FILTER_WINDOW				25			// Three periods, 50ms
+#else
+	#error "MAINS_HZ must be 50 or 60"
+#endif
+
+#if (FILTER_CYCLE*FILTER_SAMPLE_MS*MAINS_HZ)%1000 || FILTER_WINDOW%FILTER_CYCLE
+	#error "The filter window must be a whole number of mains periods"
+#endif
+
+/* Stage selection, stored as one byte */
+#define FILTER_MEDIAN					(0b00000011)
+#define FILTER_MEDIAN_OFF			(0b00000000)
+#define FILTER_MEDIAN_3				(0b00000001)
+#define FILTER_MEDIAN_5				(0b00000010)
+#define FILTER_BOX						(0b00000100)
+#define FILTER_IIR						(0b00111000)
+#define FILTER_IIR_SHIFT(n)		((n)<<3)	// Smoothing 1/2^n, 0 is off
+#define FILTER_DEFAULT				(FILTER_MEDIAN_OFF|FILTER_BOX)
+
+typedef struct {
+	uint8_t config;
+	uint8_t primed;
+	uint16_t history[5];		// Median input, newest at pos
+	uint8_t pos;
+	uint16_t window[FILTER_WINDOW];
+	uint8_t slot;						// Oldest box entry, replaced next
+	uint16_t sum;
+	uint32_t iir;						// Q8 counts
+} filter_t;
+
+void filter_init(filter_t *f, uint8_t config);
+void filter_configure(filter_t *f, uint8_t config);
+uint16_t filter_sample(filter_t *f, uint16_t reading, bool usable);
+uint16_t filter_delay_ms(uint8_t config);
+
+#endif // FILTER_H
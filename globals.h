@@ -37,6 +37,12 @@
 	#define CPU_DEFAULT()				CPU_PRESCALE(CPU_1M)
 #endif
 
+/* Fixed-point temperatures are stored in 1/16ths of a degree Celsius */
+#define TEMP_FRAC_BITS				4
+#define TEMP_FX(c)						((int16_t)((c)*(1<<TEMP_FRAC_BITS)))
+#define TEMP_INT(x)						((x)>>TEMP_FRAC_BITS)
+#define TEMP_FX_MAX						TEMP_FX(1000)
+
 /* Serial baud rate */
 #define BAUD_RATE 9600
 
@@ -59,10 +65,37 @@ static const char canceltimermsg[] PROGMEM = "Cancelling in %d";
 static const char comingsoonmsg[] PROGMEM = "Coming soon!";
 static const char dooropenmsg[] PROGMEM = "Door open!";
 static const char pleaseclosedoormsg[] PROGMEM = "Please close door!";
+static const char runpausedmsg[] PROGMEM = "Run paused";
+static const char resumewithinmsg[] PROGMEM = "Close within %2us";
 static const char tcerrormsg[] PROGMEM = "Thermocouple error!";
 static const char checktcmsg[] PROGMEM = "Check thermocouple!";
+static const char runawaymsg[] PROGMEM = "Thermal runaway!";
+static const char ineffectivemsg[] PROGMEM = "Heater ineffective!";
+static const char heatershutdownmsg[] PROGMEM = "Heater shut down";
+static const char powercyclemsg[] PROGMEM = "Power off to reset.";
+static const char watchdogresetmsg[] PROGMEM = "Watchdog reset!";
+static const char brownoutresetmsg[] PROGMEM = "Brown-out reset!";
+static const char resetcountmsg[] PROGMEM = "Watchdog resets: %u";
 static const char presstocontinuemsg[] PROGMEM = "Press \15 to continue.";
 static const char reflowcancelledmsg[] PROGMEM = "Reflow cancelled!";
 static const char reflowcompletemsg[] PROGMEM = "Reflow complete!";
+static const char talmsg[] PROGMEM = "TAL %us Peak %.0f%s";
+static const char batchunloadmsg[] PROGMEM = "Run %u/%u: open door";
+static const char batchnextmsg[] PROGMEM = "Next run: %u of %u";
+static const char batchcoolingmsg[] PROGMEM = "Cooling to %.0f%s";
+static const char safetoopenmsg[] PROGMEM = "Safe to open door";
+static const char energymsg[] PROGMEM = "%.1fWh Pk%u%% Sk%u%%";
+static const char autotunemsg[] PROGMEM = "Autotuning";
+static const char autotunecompletemsg[] PROGMEM = "Autotune complete!";
+static const char autotunefailedmsg[] PROGMEM = "Autotune failed!";
+static const char characterizemsg[] PROGMEM = "Characterizing";
+static const char characterizecompletemsg[] PROGMEM = "Oven characterized!";
+static const char characterizefailedmsg[] PROGMEM = "Characterize failed!";
+static const char calibratelowmsg[] PROGMEM = "Calibrate low point";
+static const char calibratehighmsg[] PROGMEM = "Calibrate high point";
+static const char calibrateturnmsg[] PROGMEM = "Turn to set actual  ";
+static const char calibrateclosemsg[] PROGMEM = "Too near other point";
+static const char calibrateprobemsg[] PROGMEM = "Probe:  %5.1f\10C ";
+static const char calibrateactualmsg[] PROGMEM = "Actual: %5d\10C ";
 
 #endif // GLOBAL_H
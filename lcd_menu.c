@@ -15,16 +15,42 @@ const char global_back[] PROGMEM = "\177 Back";
 // Main Menu
 const char mm_pb[MENU_LABEL_LENGTH] PROGMEM =			"Leaded Profile";
 const char mm_rohs[MENU_LABEL_LENGTH] PROGMEM =		"RoHS Profile";
+const char mm_batch[MENU_LABEL_LENGTH] PROGMEM =	"Batch Run";
 const char mm_opts[MENU_LABEL_LENGTH] PROGMEM =		"Settings";
 const char mm_about[MENU_LABEL_LENGTH] PROGMEM =	"About Software";
 PGM_P main_menu[MENU_LENGTH_main] PROGMEM =
-{ mm_pb, mm_rohs, mm_opts, mm_about };
+{ mm_pb, mm_rohs, mm_batch, mm_opts, mm_about };
+
+// Batch Run
+PGM_P batch_menu[MENU_LENGTH_batch] PROGMEM =
+{ global_back, mm_pb, mm_rohs };
+
+// Batch Size
+const char bm_2[MENU_LABEL_LENGTH] PROGMEM = "2 Boards";
+const char bm_5[MENU_LABEL_LENGTH] PROGMEM = "5 Boards";
+const char bm_10[MENU_LABEL_LENGTH] PROGMEM = "10 Boards";
+const char bm_20[MENU_LABEL_LENGTH] PROGMEM = "20 Boards";
+PGM_P batchcount_menu[MENU_LENGTH_batchcount] PROGMEM =
+{ global_back, bm_2, bm_5, bm_10, bm_20 };
+
+// Interrupted Run
+const char rm_resume[MENU_LABEL_LENGTH] PROGMEM = "Resume Run";
+const char rm_discard[MENU_LABEL_LENGTH] PROGMEM = "Discard Run";
+PGM_P resume_menu[MENU_LENGTH_resume] PROGMEM =
+{ rm_resume, rm_discard };
 
 // Settings
 const char sm_tempunits[] PROGMEM = "Temp. Units";
 const char sm_uisounds[] PROGMEM = "Sounds";
+const char sm_standby[] PROGMEM = "Warm Standby";
+const char sm_autotune[] PROGMEM = "Autotune PID";
+const char sm_characterize[] PROGMEM = "Characterize Oven";
+const char sm_calibrate[] PROGMEM = "Calibrate Sensor";
+const char sm_filter[] PROGMEM = "Sensor Filter";
+const char sm_probe[] PROGMEM = "Control Probe";
 PGM_P settings_menu[MENU_LENGTH_settings] PROGMEM =
-{ global_back, sm_tempunits, sm_uisounds };
+{ global_back, sm_tempunits, sm_uisounds, sm_standby, sm_autotune,
+  sm_characterize, sm_calibrate, sm_filter, sm_probe };
 
 // Temperature Units
 const char um_c[MENU_LABEL_LENGTH] PROGMEM = "Celsius";
@@ -46,6 +72,36 @@ const char som_high[] PROGMEM = "High";
 PGM_P sounds_menu[MENU_LENGTH_sounds] PROGMEM =
 { som_off, som_low, som_med, som_high };
 
+// Warm Standby Temperature
+const char stm_off[] PROGMEM = "Off";
+const char stm_low[] PROGMEM = "80\10C";
+const char stm_med[] PROGMEM = "100\10C";
+const char stm_high[] PROGMEM = "120\10C";
+PGM_P standby_menu[MENU_LENGTH_standby] PROGMEM =
+{ stm_off, stm_low, stm_med, stm_high };
+
+// Sensor Calibration
+const char cm_low[] PROGMEM = "Low Point";
+const char cm_high[] PROGMEM = "High Point";
+const char cm_default[] PROGMEM = "Factory Default";
+PGM_P calibrate_menu[MENU_LENGTH_calibrate] PROGMEM =
+{ global_back, cm_low, cm_high, cm_default };
+
+// Sensor Filter
+const char fm_fast[] PROGMEM = "Fast";
+const char fm_spike[] PROGMEM = "Spike Reject";
+const char fm_smooth[] PROGMEM = "Smooth";
+const char fm_vsmooth[] PROGMEM = "Very Smooth";
+PGM_P filter_menu[MENU_LENGTH_filter] PROGMEM =
+{ fm_fast, fm_spike, fm_smooth, fm_vsmooth };
+
+// Control Probe
+const char pm_air[] PROGMEM = "Oven Air";
+const char pm_board[] PROGMEM = "Board Surface";
+const char pm_both[] PROGMEM = "Air + Board";
+PGM_P probe_menu[MENU_LENGTH_probe] PROGMEM =
+{ pm_air, pm_board, pm_both };
+
 volatile uint8_t menuitem = 0, menuitem_prev = 0;
 
 void menu_init_func(PGM_P *menu, uint8_t len) {
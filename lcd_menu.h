@@ -3,14 +3,28 @@
 
 #define MENU_LABEL_LENGTH LCD_DISP_LENGTH-4
 
-#define MENU_LENGTH_main 4
+#define MENU_LENGTH_main 5
 PGM_P main_menu[MENU_LENGTH_main];
-#define MENU_LENGTH_settings 3
+#define MENU_LENGTH_batch 3
+PGM_P batch_menu[MENU_LENGTH_batch];
+#define MENU_LENGTH_batchcount 5
+PGM_P batchcount_menu[MENU_LENGTH_batchcount];
+#define MENU_LENGTH_resume 2
+PGM_P resume_menu[MENU_LENGTH_resume];
+#define MENU_LENGTH_settings 9
 PGM_P settings_menu[MENU_LENGTH_settings];
 #define MENU_LENGTH_units 8
 PGM_P units_menu[MENU_LENGTH_units];
 #define MENU_LENGTH_sounds 4
 PGM_P sounds_menu[MENU_LENGTH_sounds];
+#define MENU_LENGTH_standby 4
+PGM_P standby_menu[MENU_LENGTH_standby];
+#define MENU_LENGTH_calibrate 4
+PGM_P calibrate_menu[MENU_LENGTH_calibrate];
+#define MENU_LENGTH_filter 4
+PGM_P filter_menu[MENU_LENGTH_filter];
+#define MENU_LENGTH_probe 3
+PGM_P probe_menu[MENU_LENGTH_probe];
 
 PGM_P *activemenu;
 uint8_t activemenulen;
@@ -0,0 +1,105 @@
+#include "globals.h"
+#include "pid.h"
+#include "model.h"
+
+// Oven characterization: heat the empty oven at full power up to CHAR_TARGET,
+// then let it cool. The steepest rise gives the dead time by the tangent
+// method, the cooling rate gives the time constant, and the two together
+// give the steady-state gain of a first-order-plus-dead-time model.
+
+void model_char_start(characterize_t *ch, int16_t ambient, uint16_t dt_ms) {
+	ch->state = CHAR_HEATING;
+	ch->count = 0;
+	ch->sample_steps = CHAR_SAMPLE_MS/dt_ms;
+	ch->div = 1;
+	ch->smax = 0;
+	ch->smax_at = 0;
+	ch->smax_temp = ambient;
+	ch->peak = ambient;
+	ch->timeout = CHAR_TIMEOUT*1000UL/CHAR_SAMPLE_MS;
+	ch->result.ambient = ambient;
+}
+
+static void model_char_finish(characterize_t *ch, int16_t measured, int16_t slope) {
+	const uint8_t span_s = CHAR_SLOPE_SPAN*CHAR_SAMPLE_MS/1000;
+	int16_t rise = measured-ch->result.ambient;
+	if(slope>=0 || rise<=0 || ch->smax<=0) {
+		ch->state = CHAR_FAILED;
+		return;
+	}
+	
+	// Newton cooling: dT/dt = -(T-Tamb)/tau
+	uint32_t tau = ((uint32_t)rise*span_s)/(-slope);
+	// Gain is the rise the steepest slope would reach after one time constant
+	uint32_t gain = ((uint32_t)ch->smax*tau)/(span_s<<TEMP_FRAC_BITS);
+	// Tangent at the steepest point meets ambient at the end of the dead time;
+	// the slope is measured across the span, so its centre is half a span back
+	int32_t at_s = (int32_t)ch->smax_at*CHAR_SAMPLE_MS/1000-span_s/2;
+	int32_t lead_s = ((int32_t)(ch->smax_temp-ch->result.ambient)*span_s)/ch->smax;
+	int32_t deadtime = at_s-lead_s;
+	
+	ch->result.tau = (tau>0xFFFF)?0xFFFF:tau;
+	ch->result.gain = (gain>0xFFFF)?0xFFFF:gain;
+	ch->result.deadtime = (deadtime<0)?0:deadtime;
+	ch->state = (ch->result.gain && ch->result.tau)?CHAR_DONE:CHAR_FAILED;
+}
+
+uint16_t model_char_update(characterize_t *ch, int16_t measured) {
+	if(ch->state!=CHAR_HEATING && ch->state!=CHAR_COOLING) return 0;
+	
+	if(measured>TEMP_FX(CHAR_TARGET+CHAR_OVERSHOOT)) {
+		ch->state = CHAR_FAILED;
+		return 0;
+	}
+	
+	if(!--ch->div) {
+		ch->div = ch->sample_steps;
+		if(!ch->timeout--) {
+			ch->state = CHAR_FAILED;
+			return 0;
+		}
+		
+		// Shift the new sample in and take the slope across the whole span
+		for(uint8_t i=0; i<CHAR_SLOPE_SPAN; i++)
+			ch->samples[i] = ch->samples[i+1];
+		ch->samples[CHAR_SLOPE_SPAN] = measured;
+		if(ch->count<UINT16_MAX) ch->count++;
+		int16_t slope = 0;
+		if(ch->count>CHAR_SLOPE_SPAN)
+			slope = ch->samples[CHAR_SLOPE_SPAN]-ch->samples[0];
+		
+		if(ch->state==CHAR_HEATING) {
+			if(slope>ch->smax) {
+				ch->smax = slope;
+				ch->smax_at = ch->count-1;
+				ch->smax_temp = ch->samples[CHAR_SLOPE_SPAN/2];
+			}
+			if(measured>=TEMP_FX(CHAR_TARGET)) {
+				ch->state = CHAR_COOLING;
+				ch->peak = measured;
+			}
+		} else {
+			if(measured>ch->peak) ch->peak = measured;
+			if(measured<=ch->peak-TEMP_FX(CHAR_COOL_DROP))
+				model_char_finish(ch, measured, slope);
+		}
+	}
+	
+	return (ch->state==CHAR_HEATING)?POWER_MAX:0;
+}
+
+
+
+bool model_valid(const ovenmodel_t *m) {
+	return (m->gain && m->gain!=0xFFFF && m->tau!=0xFFFF);
+}
+
+// Steady-state power to hold the setpoint, plus what it takes to move the
+// oven's first-order lag along at the given slope (fixed-point degrees/s).
+// The caller looks the setpoint up one dead time ahead.
+uint16_t model_feedforward(const ovenmodel_t *m, int16_t setpoint, int16_t slope) {
+	int32_t drive = (int32_t)(setpoint-m->ambient)+(int32_t)slope*m->tau;
+	if(drive<=0) return 0;
+	uint32_t u = ((uint32_t)drive*POWER_MAX)/((uint32_t)m->gain<<TEMP_FRAC_BITS);
+	return (u>POWER_MAX)?POWER_MAX:u;
+}
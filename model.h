@@ -0,0 +1,49 @@
+#ifndef MODEL_H
+#define MODEL_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+/* Characterization run settings */
+#define CHAR_TARGET					150			// Switch the heater off at this temperature
+#define CHAR_COOL_DROP			10			// Measure cooling this far below the peak
+#define CHAR_SAMPLE_MS			1000		// Slope sampling interval
+#define CHAR_SLOPE_SPAN			4				// Slope is taken across this many samples
+#define CHAR_OVERSHOOT			80			// Abort if this far above the target
+#define CHAR_TIMEOUT				1800		// Abort after this many seconds
+
+#define CHAR_IDLE						0
+#define CHAR_HEATING				1
+#define CHAR_COOLING				2
+#define CHAR_DONE						3
+#define CHAR_FAILED					4
+
+// First-order-plus-dead-time oven model, as stored in EEPROM
+typedef struct {
+	uint16_t gain;				// Steady-state rise above ambient at full power, degrees
+	uint16_t tau;					// Time constant in seconds
+	uint16_t deadtime;		// Dead time in seconds
+	int16_t ambient;			// Ambient during characterization, fixed-point degrees
+} ovenmodel_t;
+
+typedef struct {
+	uint8_t state;
+	uint16_t count;				// Samples taken so far
+	uint16_t div;					// Control steps until the next sample
+	uint16_t sample_steps;
+	int16_t samples[CHAR_SLOPE_SPAN+1];
+	int16_t smax;					// Steepest rise, fixed-point degrees per span
+	uint16_t smax_at;			// Sample index at the steepest rise
+	int16_t smax_temp;
+	int16_t peak;
+	uint16_t timeout;			// Samples until the run is abandoned
+	ovenmodel_t result;
+} characterize_t;
+
+void model_char_start(characterize_t *ch, int16_t ambient, uint16_t dt_ms);
+uint16_t model_char_update(characterize_t *ch, int16_t measured);
+
+bool model_valid(const ovenmodel_t *m);
+uint16_t model_feedforward(const ovenmodel_t *m, int16_t setpoint, int16_t slope);
+
+#endif // MODEL_H
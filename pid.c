@@ -0,0 +1,152 @@
+#include "globals.h"
+#include "pid.h"
+
+// Fixed-point PID controller in standard form, with the derivative taken on a
+// filtered copy of the measurement and conditional integration for anti-windup.
+// Temperatures are in the global fixed-point format; outputs are in per mille.
+// A feedforward demand can be added in ahead of the feedback terms, and takes
+// part in the saturation checks so the integral doesn't wind up against it.
+// The integral may go negative as far as cancelling the feedforward, so an
+// estimate that asks for too much heat can still be trimmed back to nothing.
+
+void pid_init(pidctrl_t *pid, const pidgains_t *gains, uint16_t dt_ms) {
+	uint32_t steps;
+	pid->kp = gains->kp;
+	steps = (uint32_t)gains->ti*1000/dt_ms;
+	pid->ti_steps = (steps>0xFFFF)?0xFFFF:steps;
+	steps = (uint32_t)gains->td*1000/dt_ms;
+	pid->td_steps = (steps>0xFFFF)?0xFFFF:steps;
+	
+	// Pick the largest power of two not exceeding Td/N for the derivative filter
+	pid->dshift = 0;
+	steps = pid->td_steps/PID_DFILTER_N;
+	while((2UL<<pid->dshift)<=steps && pid->dshift<12) pid->dshift++;
+	
+	// Limit the error sum to what it takes to saturate the integral term alone
+	if(pid->kp && pid->ti_steps)
+		pid->esum_max = ((PID_OUT_MAX<<TEMP_FRAC_BITS)/pid->kp)*pid->ti_steps;
+	else
+		pid->esum_max = 0;
+	pid_reset(pid, 0);
+}
+
+void pid_reset(pidctrl_t *pid, int16_t measured) {
+	pid->esum = 0;
+	pid->mfilt = (int32_t)measured<<8;
+	pid->out = 0;
+}
+
+// Pick up again after a pause: the integral still holds the power the
+// setpoint needed, but the derivative filter has to forget the jump
+void pid_resume(pidctrl_t *pid, int16_t measured) {
+	pid->mfilt = (int32_t)measured<<8;
+}
+
+uint16_t pid_update(pidctrl_t *pid, int16_t setpoint, int16_t measured, uint16_t feedforward) {
+	int32_t e = setpoint-measured;
+	int32_t p = ((int32_t)pid->kp*e)>>TEMP_FRAC_BITS;
+	
+	// Derivative on the filtered measurement, so setpoint steps don't kick it
+	int32_t prev = pid->mfilt;
+	pid->mfilt += (((int32_t)measured<<8)-pid->mfilt)>>pid->dshift;
+	int32_t dm = pid->mfilt-prev;
+	if(dm>INT16_MAX)	dm = INT16_MAX;
+	if(dm<-INT16_MAX)	dm = -INT16_MAX;
+	int32_t d = ((int32_t)pid->kp*dm)>>8;
+	if(pid->td_steps) {
+		int32_t dlim = (PID_OUT_MAX<<TEMP_FRAC_BITS)/pid->td_steps;
+		if(d>dlim)	d = dlim;
+		if(d<-dlim)	d = -dlim;
+		d = (d*pid->td_steps)>>TEMP_FRAC_BITS;
+	} else {
+		d = 0;
+	}
+	
+	// Integral term, only committed if it doesn't push a saturated output further
+	int32_t esum_min = 0;
+	if(pid->kp && pid->ti_steps)
+		esum_min = -((((int32_t)feedforward<<(PID_SHIFT+TEMP_FRAC_BITS))/pid->kp)*pid->ti_steps);
+	int32_t esum = pid->esum+e;
+	if(esum<esum_min)				esum = esum_min;
+	if(esum>pid->esum_max)	esum = pid->esum_max;
+	int32_t i = 0;
+	if(pid->ti_steps)
+		i = ((esum/pid->ti_steps)*pid->kp)>>TEMP_FRAC_BITS;
+	
+	int32_t u = ((int32_t)feedforward<<PID_SHIFT)+p+i-d;
+	if(!((u>PID_OUT_MAX && e>0) || (u<0 && e<0)))
+		pid->esum = esum;
+	if(u<0)						u = 0;
+	if(u>PID_OUT_MAX)	u = PID_OUT_MAX;
+	pid->out = u;
+	
+	return (u+(1<<(PID_SHIFT-1)))>>PID_SHIFT;
+}
+
+
+
+// Relay-feedback autotune: switch the heater fully on and off around the
+// setpoint, then derive the ultimate gain and period from the resulting
+// oscillation. Gains use the "no overshoot" Ziegler-Nichols rule.
+
+void autotune_start(autotune_t *at, int16_t setpoint, uint16_t dt_ms) {
+	at->state = AUTOTUNE_RUNNING;
+	at->cycles = 0;
+	at->heating = true;
+	at->setpoint = setpoint;
+	at->tmax = INT16_MIN;
+	at->tmin = INT16_MAX;
+	at->ampsum = 0;
+	at->steps = 0;
+	at->laststart = 0;
+	at->periodsum = 0;
+	at->dt_ms = dt_ms;
+}
+
+static void autotune_finish(autotune_t *at) {
+	int16_t amp = at->ampsum/(2*AUTOTUNE_CYCLES);
+	if(amp<1) amp = 1;
+	uint32_t tu_ms = at->periodsum*at->dt_ms/AUTOTUNE_CYCLES;
+	
+	// Ku = 4d/(pi*a), with d being half the relay swing
+	uint32_t ku = ((((uint32_t)2*POWER_MAX)<<(8+TEMP_FRAC_BITS))*7/22)/amp;
+	uint32_t kp = ku/5;
+	at->result.kp = (kp>0xFFFF)?0xFFFF:kp;
+	at->result.ti = tu_ms/2000;
+	at->result.td = tu_ms/3000;
+	if(!at->result.ti) at->result.ti = 1;
+	at->state = AUTOTUNE_DONE;
+}
+
+uint16_t autotune_update(autotune_t *at, int16_t measured) {
+	if(at->state!=AUTOTUNE_RUNNING) return 0;
+	at->steps++;
+	
+	if(measured>at->setpoint+TEMP_FX(AUTOTUNE_OVERSHOOT) ||
+		 at->steps>AUTOTUNE_TIMEOUT*1000UL/at->dt_ms) {
+		at->state = AUTOTUNE_FAILED;
+		return 0;
+	}
+	
+	if(measured>at->tmax)	at->tmax = measured;
+	if(measured<at->tmin)	at->tmin = measured;
+	
+	if(at->heating && measured>at->setpoint+TEMP_FX(AUTOTUNE_HYSTERESIS)) {
+		at->heating = false;
+	} else if(!at->heating && measured<at->setpoint-TEMP_FX(AUTOTUNE_HYSTERESIS)) {
+		at->heating = true;
+		// The first switch-on only ends the approach from ambient
+		if(at->cycles) {
+			at->ampsum += at->tmax-at->tmin;
+			at->periodsum += at->steps-at->laststart;
+		}
+		if(at->cycles++==AUTOTUNE_CYCLES) {
+			autotune_finish(at);
+			return 0;
+		}
+		at->laststart = at->steps;
+		at->tmax = at->tmin = measured;
+	}
+	
+	return at->heating?POWER_MAX:0;
+}
@@ -0,0 +1,75 @@
+#ifndef PID_H
+#define PID_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+/* Heater demand is expressed in tenths of a percent */
+#define POWER_MAX						1000
+
+/* Internal PID terms carry 8 extra fractional bits of output */
+#define PID_SHIFT						8
+#define PID_OUT_MAX					((int32_t)POWER_MAX<<PID_SHIFT)
+
+/* Derivative filter time constant is Td/PID_DFILTER_N */
+#define PID_DFILTER_N				8
+
+/* Default gains, used until the oven has been autotuned */
+#define PID_DEFAULT_KP			(40<<8)		// 40.0 per mille per degree
+#define PID_DEFAULT_TI			120				// 120s integral time
+#define PID_DEFAULT_TD			20				// 20s derivative time
+
+/* Relay autotune settings */
+#define AUTOTUNE_SETPOINT		150				// Degrees Celsius
+#define AUTOTUNE_HYSTERESIS	1					// Degrees Celsius either side of setpoint
+#define AUTOTUNE_CYCLES			3					// Cycles measured after the first one
+#define AUTOTUNE_OVERSHOOT	50				// Abort if this far above setpoint
+#define AUTOTUNE_TIMEOUT		1200			// Abort after this many seconds
+
+#define AUTOTUNE_IDLE				0
+#define AUTOTUNE_RUNNING		1
+#define AUTOTUNE_DONE				2
+#define AUTOTUNE_FAILED			3
+
+// Standard-form gains, as stored in EEPROM
+typedef struct {
+	uint16_t kp;				// Proportional gain, Q8 per mille per degree
+	uint16_t ti;				// Integral time in seconds
+	uint16_t td;				// Derivative time in seconds
+} pidgains_t;
+
+typedef struct {
+	uint16_t kp;
+	uint16_t ti_steps;	// Integral and derivative times in control steps
+	uint16_t td_steps;
+	uint8_t dshift;			// Derivative filter shift, from Td/PID_DFILTER_N
+	int32_t esum;				// Accumulated error for the integral term
+	int32_t esum_max;
+	int32_t mfilt;			// Filtered measurement, Q8 fixed-point degrees
+	int32_t out;				// Last output, Q8 per mille
+} pidctrl_t;
+
+typedef struct {
+	uint8_t state;
+	uint8_t cycles;
+	bool heating;
+	int16_t setpoint;
+	int16_t tmax;
+	int16_t tmin;
+	int32_t ampsum;			// Sum of measured peak-to-peak swings
+	uint32_t steps;			// Control steps since start
+	uint32_t laststart;	// Step at which the last cycle started
+	uint32_t periodsum;	// Sum of measured cycle lengths, in steps
+	uint16_t dt_ms;
+	pidgains_t result;
+} autotune_t;
+
+void pid_init(pidctrl_t *pid, const pidgains_t *gains, uint16_t dt_ms);
+void pid_reset(pidctrl_t *pid, int16_t measured);
+void pid_resume(pidctrl_t *pid, int16_t measured);
+uint16_t pid_update(pidctrl_t *pid, int16_t setpoint, int16_t measured, uint16_t feedforward);
+
+void autotune_start(autotune_t *at, int16_t setpoint, uint16_t dt_ms);
+uint16_t autotune_update(autotune_t *at, int16_t measured);
+
+#endif // PID_H
@@ -0,0 +1,182 @@
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "pid.h"
+#include "power.h"
+
+// Turns a 0 to POWER_MAX demand into an on/off stream for the SSR. The stream
+// is advanced from the deferred tasks, catching up with however many ticks
+// have gone by, while the timer interrupt only switches the outputs the step
+// has cleared, on a zero crossing and once the minimum on or off time has passed.
+// What the output actually delivers, after those restrictions, is compared
+// with the demand and the difference carried over, so the average is kept.
+// Each heater channel keeps its own demand and carry, but they share the
+// window and the zero-crossing detection, and all are advanced in one pass.
+
+static uint8_t ticklen;
+static uint16_t window;
+static uint16_t min_on;
+static uint16_t min_off;
+
+// Per-channel output state
+typedef struct {
+	volatile uint16_t demand;
+	bool output;
+	uint16_t hold;
+	int32_t carry;
+#if POWER_MODE == POWER_MODE_TPROP
+	uint16_t on_ticks;
+	uint16_t delivered;		// Ticks actually on in this window
+#endif
+} channel_t;
+
+static channel_t channels[POWER_CHANNELS];
+static volatile bool zc_pending = false;
+static volatile uint8_t want_mask = 0;			// What the step wants each channel to be
+static volatile uint8_t free_mask = 0;			// Channels past their minimum on or off time
+static volatile uint8_t out_mask = 0;				// What the tick is driving
+static volatile uint8_t ticks_pending = 0;	// Ticks the step hasn't caught up with
+#if POWER_MODE == POWER_MODE_TPROP
+static uint16_t phase = 0;	// Shared, so every channel's window starts together
+#endif
+#if POWER_ZC == POWER_ZC_SIMULATED
+static uint16_t zc_phase_us = 0;
+#endif
+
+void power_init(uint8_t tick_ms) {
+	ticklen = tick_ms;
+	window = POWER_WINDOW_MS/tick_ms;
+	min_on = (POWER_MIN_ON_MS+tick_ms-1)/tick_ms;
+	min_off = (POWER_MIN_OFF_MS+tick_ms-1)/tick_ms;
+	power_reset();
+}
+
+void power_reset(void) {
+	uint8_t sreg = SREG;
+	cli();
+	for(uint8_t i=0; i<POWER_CHANNELS; i++) {
+		channel_t *c = &channels[i];
+		c->demand = 0;
+		c->output = false;
+		c->hold = 0;
+		c->carry = 0;
+#if POWER_MODE == POWER_MODE_TPROP
+		c->on_ticks = c->delivered = 0;
+#endif
+	}
+#if POWER_MODE == POWER_MODE_TPROP
+	phase = window-1;	// So the first step settles a window straight away
+#endif
+	want_mask = free_mask = out_mask = 0;
+	ticks_pending = 0;
+	SREG = sreg;
+}
+
+void power_set(uint8_t ch, uint16_t d) {
+	if(ch>=POWER_CHANNELS) return;
+	if(d>POWER_MAX) d = POWER_MAX;
+	uint8_t sreg = SREG;
+	cli();
+	channels[ch].demand = d;
+	SREG = sreg;
+}
+
+void power_zero_cross(void) {
+	zc_pending = true;
+}
+
+// Whether this tick falls on a zero crossing, shared by all channels
+static inline bool power_zero_crossed(void) {
+#if POWER_ZC == POWER_ZC_SIMULATED
+	zc_phase_us += ticklen*1000;
+	if(zc_phase_us>=(1000000UL/(2*MAINS_HZ))) {
+		zc_phase_us -= (1000000UL/(2*MAINS_HZ));
+		zc_pending = true;
+	}
+#elif POWER_ZC == POWER_ZC_NONE
+	zc_pending = true;
+#endif
+	if(!zc_pending) return false;
+	zc_pending = false;
+	return true;
+}
+
+// Tick: switch the channels the deferred step has cleared and report the
+// outputs. Only whole masks are touched, so the cost doesn't grow with the
+// channel count.
+uint8_t power_update(void) {
+	if(power_zero_crossed()) {
+		uint8_t change = (want_mask^out_mask)&free_mask;
+		out_mask ^= change;
+		free_mask &= ~change;	// Held until the step starts its minimum time
+	}
+	if(ticks_pending<UINT8_MAX) ticks_pending++;
+	return out_mask;
+}
+
+// Deferred: catch each channel up with the ticks since the last call and
+// decide what the tick should switch to at the next zero crossing
+void power_step(void) {
+	uint8_t sreg = SREG;
+	cli();
+	uint8_t n = ticks_pending;
+	uint8_t out = out_mask;
+	ticks_pending = 0;
+	SREG = sreg;
+	if(!n) return;
+	
+	uint8_t want = 0, ready = 0;
+	for(uint8_t i=0; i<POWER_CHANNELS; i++) {
+		channel_t *c = &channels[i];
+		bool now = out&(1<<i);
+		if(now!=c->output) {
+			c->output = now;
+			c->hold = c->output?min_on:min_off;
+		}
+		bool on = false;
+		
+		for(uint8_t t=0; t<n; t++) {
+#if POWER_MODE == POWER_MODE_TPROP
+			if(c->output) c->delivered++;
+			uint16_t next = phase+t+1;
+			while(next>=window) next -= window;
+			// Work out the next window's on-time, rounding away pulses the SSR can't
+			// give. Whatever waiting for zero crossings and minimum times added to or
+			// took from this window's on-time is settled in the next one.
+			if(next==0) {
+				int32_t energy = (int32_t)c->demand*window+c->carry+
+												 ((int32_t)c->on_ticks-c->delivered)*POWER_MAX;
+				if(energy<0) energy = 0;
+				c->on_ticks = (energy/POWER_MAX>window)?window:energy/POWER_MAX;
+				if(c->on_ticks<min_on)								c->on_ticks = 0;
+				else if(window-c->on_ticks<min_off)		c->on_ticks = window;
+				c->carry = energy-(int32_t)c->on_ticks*POWER_MAX;
+				if(c->carry>(int32_t)POWER_MAX*window)	c->carry = (int32_t)POWER_MAX*window;
+				c->delivered = 0;
+			}
+			on = (next<c->on_ticks);
+#else
+			// Integrate demand against delivered power and switch on the running error
+			c->carry += c->demand;
+			if(c->output) c->carry -= POWER_MAX;
+			if(c->carry>(int32_t)POWER_MAX*window)	c->carry = (int32_t)POWER_MAX*window;
+			if(c->carry<-(int32_t)POWER_MAX*window)	c->carry = -(int32_t)POWER_MAX*window;
+			on = (c->carry>0);
+#endif
+			if(c->hold) c->hold--;
+		}
+		if(on)				want |= (1<<i);
+		if(!c->hold)	ready |= (1<<i);
+	}
+#if POWER_MODE == POWER_MODE_TPROP
+	phase += n;
+	while(phase>=window) phase -= window;
+#endif
+	
+	// A channel the tick switched since we looked hasn't started its hold yet
+	sreg = SREG;
+	cli();
+	want_mask = want;
+	free_mask = ready&~(out_mask^out);
+	SREG = sreg;
+}
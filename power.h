@@ -0,0 +1,36 @@
+#ifndef POWER_H
+#define POWER_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+/* Output modulation modes */
+#define POWER_MODE_TPROP			0		// Time-proportioned over a fixed window
+#define POWER_MODE_SIGMADELTA	1		// Error-feedback bit stream
+
+/* Zero-crossing alignment */
+#define POWER_ZC_NONE					0		// Switch on any tick
+#define POWER_ZC_SIMULATED		1		// Switch on zero crossings derived from the tick
+#define POWER_ZC_INPUT				2		// Switch on zero crossings from the detector on PB0
+
+/* Output stage configuration */
+#define POWER_MODE						POWER_MODE_TPROP
+#define POWER_ZC							POWER_ZC_SIMULATED
+#define POWER_WINDOW_MS				1000	// Time-proportioning window
+#define POWER_MIN_ON_MS				20		// Shortest pulse the SSR is given
+#define POWER_MIN_OFF_MS			20		// Shortest gap the SSR is given
+#define MAINS_HZ							50
+#define POWER_CHANNELS				1			// 2 adds the bottom heater SSR on PB1
+
+#if POWER_CHANNELS < 1 || POWER_CHANNELS > 2
+	#error "POWER_CHANNELS must be 1 or 2"
+#endif
+
+void power_init(uint8_t tick_ms);
+void power_reset(void);
+void power_set(uint8_t ch, uint16_t demand);
+uint8_t power_update(void);
+void power_step(void);
+void power_zero_cross(void);
+
+#endif // POWER_H
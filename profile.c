@@ -0,0 +1,319 @@
+#include "globals.h"
+#include "pid.h"
+#include "profile.h"
+
+// Profile engine. A profile is a start temperature followed by a variable
+// number of segments, each ending at a temperature after a nominal time. The
+// engine steps through them as the run goes on; a segment may carry
+// conditions that hold its end temperature until the oven has actually
+// caught up, so stages advance on temperature rather than on the clock alone.
+//
+// The peak stage is also governed by a time-above-liquidus guard when the
+// profile gives a liquidus: it ends as soon as the time spent above liquidus,
+// plus the time expected to fall back below it, reaches the middle of the
+// profile's TAL window. That shortens the peak for light loads and extends
+// it, up to PROFILE_HOLD_MAX, for heavy ones.
+//
+// The first preheat segment doubles as a measurement of the oven's load: the
+// rise achieved per second of full heater power, compared with the empty
+// oven, says how heavy the load is. Soak and ramp-up segments are then
+// stretched or shrunk in proportion, so light loads finish sooner and heavy
+// ones still get the time they need to reach equilibrium.
+//
+// Each segment is turned into a cubic when the profile is loaded, so working
+// out the setpoint costs one scaling multiply and three multiply-adds. With
+// spline interpolation the tangents are chosen by the Fritsch-Butland rule,
+// which keeps the curve monotone so it never overshoots a segment's end.
+
+static const char stage_preheat[] PROGMEM = "Preheat";
+static const char stage_soak[] PROGMEM = "Soak";
+static const char stage_rampup[] PROGMEM = "Ramp-up";
+static const char stage_peak[] PROGMEM = "Peak";
+static const char stage_rampdown[] PROGMEM = "Ramp-down";
+static PGM_P const stage_names[] PROGMEM =
+{ stage_preheat, stage_soak, stage_rampup, stage_peak, stage_rampdown };
+
+// Fit each segment's cubic to the temperatures at the knots, y[0] being the
+// start, over the segment lengths as they stand
+static void profile_fit(profile_t *p, const int16_t *y) {
+#if PROFILE_INTERP == PROFILE_INTERP_SPLINE
+	// Tangents in fixed-point degrees per second at each knot
+	float m[PROFILE_MAX_SEGMENTS+1];
+	for(uint8_t i=0; i<=p->count; i++) {
+		float d0 = 0, d1 = 0, h0 = 0, h1 = 0;
+		if(i>0) {
+			h0 = p->seg[i-1].len/1000.0f;
+			if(h0>0) d0 = (y[i]-y[i-1])/h0;
+		}
+		if(i<p->count) {
+			h1 = p->seg[i].len/1000.0f;
+			if(h1>0) d1 = (y[i+1]-y[i])/h1;
+		}
+		if(i==0)							m[i] = d1;
+		else if(i==p->count)	m[i] = d0;
+		else if(d0*d1<=0)			m[i] = 0;
+		else									m[i] = 3*(h0+h1)/((2*h1+h0)/d0+(h1+2*h0)/d1);
+	}
+#endif
+	
+	for(uint8_t i=0; i<p->count; i++) {
+		segment_t *g = &p->seg[i];
+		int32_t dy = y[i+1]-y[i];
+		g->y0 = y[i];
+#if PROFILE_INTERP == PROFILE_INTERP_SPLINE
+		float h = g->len/1000.0f;
+		int32_t t0 = m[i]*h;
+		int32_t t1 = m[i+1]*h;
+		g->c1 = t0;
+		g->c2 = 3*dy-2*t0-t1;
+		g->c3 = t0+t1-2*dy;
+#else
+		g->c1 = dy;
+		g->c2 = g->c3 = 0;
+#endif
+	}
+}
+
+void profile_load(profile_t *p, const profdef_t *def) {
+	profdef_t d;
+	profseg_t s[PROFILE_MAX_SEGMENTS];
+	memcpy_P(&d, def, sizeof(profdef_t));
+	if(d.count>PROFILE_MAX_SEGMENTS) d.count = PROFILE_MAX_SEGMENTS;
+	memcpy_P(s, d.segs, sizeof(profseg_t)*d.count);
+	p->count = d.count;
+	p->segs = d.segs;
+	p->split = d.split;
+	
+	// Temperature at each knot, the start being knot 0
+	int16_t y[PROFILE_MAX_SEGMENTS+1];
+	y[0] = TEMP_FX(d.starttemp);
+	for(uint8_t i=0; i<d.count; i++) {
+		y[i+1] = TEMP_FX(s[i].temp);
+		segment_t *g = &p->seg[i];
+		g->len = s[i].secs*1000UL;
+		g->k = g->len?(0x80000000UL/g->len):0;
+	}
+	profile_fit(p, y);
+	
+	p->index = 0;
+	p->cur = s[0];
+	p->elapsed = p->above = 0;
+	p->ramped = (int32_t)y[0]<<8;
+	p->done = !d.count;
+	p->liquidus = TEMP_FX(d.liquidus);
+	p->tal_target = d.liquidus?((d.tal_min+d.tal_max)*500UL):0;
+	p->tal = 0;
+	p->peak = INT16_MIN;
+	p->load_from = p->load_start = INT16_MIN;
+	p->load_duty = 0;
+	p->load_rem = 0;
+	p->load_ref = TEMP_FX(LOAD_REF_RATE)/10;
+	p->load_scale = 256;
+}
+
+// Set the empty-oven rise rate at full power, in fixed-point degrees/s
+void profile_load_reference(profile_t *p, uint16_t rate) {
+	if(rate) p->load_ref = rate;
+}
+
+static void profile_apply_scale(profile_t *p, uint16_t scale);
+
+static void profile_scale_load(profile_t *p, int16_t measured) {
+	if(p->load_start==INT16_MIN || p->load_duty<LOAD_MIN_DUTY_MS) return;
+	
+	// Rise per second at full power, against what the empty oven manages
+	int32_t rise = measured-p->load_start;
+	uint32_t scale = LOAD_SCALE_MAX;
+	if(rise>0) {
+		uint32_t rate = ((uint32_t)rise*1000+p->load_duty/2)/p->load_duty;
+		scale = rate?((((uint32_t)p->load_ref<<8)+rate/2)/rate):LOAD_SCALE_MAX;
+	}
+	if(scale<LOAD_SCALE_MIN)	scale = LOAD_SCALE_MIN;
+	if(scale>LOAD_SCALE_MAX)	scale = LOAD_SCALE_MAX;
+	profile_apply_scale(p, scale);
+}
+
+static void profile_apply_scale(profile_t *p, uint16_t scale) {
+	p->load_scale = scale;
+	
+	// Only the time spent heating the load through is scaled; the peak has its
+	// own guard and the ramp-down is limited by how fast the oven cools
+	for(uint8_t i=p->index+1; i<p->count; i++) {
+		profseg_t s;
+		memcpy_P(&s, &p->segs[i], sizeof(profseg_t));
+		if(s.stage!=STAGE_SOAK && s.stage!=STAGE_RAMPUP) continue;
+		segment_t *g = &p->seg[i];
+		g->len = (g->len*scale)>>8;
+		g->k = g->len?(0x80000000UL/g->len):0;
+	}
+	
+	// The tangents depend on the lengths either side of each knot, so the
+	// cubics are fitted again to the same knots
+	int16_t y[PROFILE_MAX_SEGMENTS+1];
+	for(uint8_t i=0; i<p->count; i++)
+		y[i] = p->seg[i].y0;
+	const segment_t *g = &p->seg[p->count-1];
+	y[p->count] = g->y0+g->c1+g->c2+g->c3;
+	profile_fit(p, y);
+}
+
+// Setpoint at a time into the given segment, holding the end once it's over
+static int16_t segment_eval(const profile_t *p, uint8_t i, uint32_t ms) {
+	const segment_t *g = &p->seg[i];
+	if(ms>=g->len) return g->y0+g->c1+g->c2+g->c3;
+	int32_t u = (ms*g->k)>>(31-PROFILE_U_BITS);
+	int32_t y = (g->c3*u)>>PROFILE_U_BITS;
+	y = ((g->c2+y)*u)>>PROFILE_U_BITS;
+	y = ((g->c1+y)*u)>>PROFILE_U_BITS;
+	return g->y0+y;
+}
+
+// Start a run in an oven that is already warm. Preheat segments that end
+// below the measured temperature are skipped, and the run picks up the
+// current one at the point where its setpoint reaches the oven.
+void profile_warm_start(profile_t *p, int16_t measured) {
+	while(p->cur.stage==STAGE_PREHEAT && p->index+1<p->count &&
+				measured>=segment_eval(p, p->index, p->seg[p->index].len)) {
+		memcpy_P(&p->cur, &p->segs[++p->index], sizeof(profseg_t));
+	}
+	if(p->cur.stage!=STAGE_PREHEAT) {
+		p->ramped = (int32_t)p->seg[p->index].y0<<8;
+		return;
+	}
+	uint32_t len = p->seg[p->index].len;
+	while(p->elapsed+1000<len && segment_eval(p, p->index, p->elapsed+1000)<=measured)
+		p->elapsed += 1000;
+	p->ramped = (int32_t)segment_eval(p, p->index, p->elapsed)<<8;
+}
+
+// Continue a run after it was paused and the oven lost heat. A rising
+// segment is wound back to where its setpoint meets the oven again, and the
+// ramp limit brings the setpoint up from there rather than stepping it. A
+// falling segment, and the ramp-down always, is never wound back: every
+// earlier point is hotter, so that would only reheat boards that are already
+// cooling. It's moved on instead to where the oven has cooled to.
+void profile_resume(profile_t *p, int16_t measured) {
+	if(p->done) return;
+	const segment_t *g = &p->seg[p->index];
+	if(p->cur.stage!=STAGE_RAMPDOWN && g->c1+g->c2+g->c3>0) {
+		while(p->elapsed>=1000 && segment_eval(p, p->index, p->elapsed)>measured)
+			p->elapsed -= 1000;
+	} else {
+		while(p->elapsed+1000<g->len && segment_eval(p, p->index, p->elapsed)>measured)
+			p->elapsed += 1000;
+	}
+	p->ramped = (int32_t)measured<<8;
+}
+
+// Put a freshly loaded profile back where a checkpoint left it
+void profile_restore(profile_t *p, uint8_t index, uint32_t elapsed, uint32_t tal,
+										 int16_t peak, uint16_t load_scale) {
+	if(index>=p->count) index = p->count-1;
+	// The load is measured through the first segment and applied at its end,
+	// to every segment after it
+	if(index>0 && load_scale>=LOAD_SCALE_MIN && load_scale<=LOAD_SCALE_MAX)
+		profile_apply_scale(p, load_scale);
+	p->index = index;
+	memcpy_P(&p->cur, &p->segs[index], sizeof(profseg_t));
+	p->elapsed = elapsed;
+	p->tal = tal;
+	p->peak = peak;
+}
+
+int16_t profile_step(profile_t *p, uint16_t dt_ms, int16_t measured, uint16_t demand) {
+	if(p->done) return segment_eval(p, p->count-1, p->seg[p->count-1].len);
+	
+	// Measure the load through the first preheat segment, once past the dead time
+	if(p->index==0 && p->cur.stage==STAGE_PREHEAT) {
+		if(p->load_from==INT16_MIN)
+			p->load_from = measured;
+		if(p->load_start!=INT16_MIN) {
+			// Carry the part of a ms each step leaves, so low demand isn't lost
+			uint32_t on = (uint32_t)demand*dt_ms+p->load_rem;
+			p->load_duty += on/POWER_MAX;
+			p->load_rem = on%POWER_MAX;
+		} else if(measured>=p->load_from+TEMP_FX(LOAD_START_RISE))
+			p->load_start = measured;
+	}
+	
+	p->elapsed += dt_ms;
+	if((p->cur.flags&SEG_HOLD_ABOVE) && measured>=TEMP_FX(p->cur.cond_temp))
+		p->above += dt_ms;
+	if(p->liquidus && measured>=p->liquidus)
+		p->tal += dt_ms;
+	if(measured>p->peak)
+		p->peak = measured;
+	
+	// Once the nominal time is up, move on unless a condition holds us here
+	uint32_t len = p->seg[p->index].len;
+	bool tal_guard = (p->tal_target && p->cur.stage==STAGE_PEAK);
+	if(p->elapsed>=len || tal_guard) {
+		bool ready = true;
+		if((p->cur.flags&SEG_HOLD_UNTIL) && measured<TEMP_FX(p->cur.cond_temp))
+			ready = false;
+		if((p->cur.flags&SEG_HOLD_ABOVE) && p->above<p->cur.cond_secs*1000UL)
+			ready = false;
+		if(tal_guard) {
+			uint32_t projected = p->tal;
+			if(measured>p->liquidus)
+				projected += ((uint32_t)(measured-p->liquidus)*10000UL)/TEMP_FX(PROFILE_TAL_COOL_RATE);
+			ready = (p->tal && projected>=p->tal_target);
+		}
+		if(p->elapsed>=len+PROFILE_HOLD_MAX*1000UL)
+			ready = true;
+		if(ready) {
+			if(p->index==0 && p->cur.stage==STAGE_PREHEAT)
+				profile_scale_load(p, measured);
+			// Carry over any part of this step that ran past a nominal end
+			p->elapsed = (p->elapsed-len<dt_ms)?(p->elapsed-len):0;
+			p->above = 0;
+			if(++p->index>=p->count) {
+				p->index = p->count-1;
+				p->done = true;
+			} else {
+				memcpy_P(&p->cur, &p->segs[p->index], sizeof(profseg_t));
+			}
+		}
+	}
+	
+	// Limit how far the setpoint may move in one step. The last value is kept
+	// with 8 extra fractional bits so short steps don't round the rate away.
+	int32_t t = (int32_t)segment_eval(p, p->index, p->elapsed)<<8;
+	int32_t rate = 0;
+	if(p->cur.flags&SEG_MAX_RAMP)	rate = ((int32_t)p->cur.ramp<<TEMP_FRAC_BITS)/10;
+#if PROFILE_MAX_RAMP
+	else													rate = TEMP_FX(PROFILE_MAX_RAMP);
+#endif
+	if(rate) {
+		int32_t step = (rate*256*dt_ms)/1000;
+		if(t>p->ramped+step)			t = p->ramped+step;
+		else if(t<p->ramped-step)	t = p->ramped-step;
+	}
+	p->ramped = t;
+	return t>>8;
+}
+
+// Nominal setpoint some time ahead, assuming no further holds
+int16_t profile_peek(const profile_t *p, uint32_t ahead_ms) {
+	uint8_t i = p->index;
+	uint32_t ms = p->elapsed+ahead_ms;
+	while(ms>=p->seg[i].len && i+1<p->count) {
+		ms = (p->elapsed>p->seg[i].len && i==p->index)?ahead_ms:ms-p->seg[i].len;
+		i++;
+	}
+	return segment_eval(p, i, ms);
+}
+
+uint8_t profile_stage(const profile_t *p) {
+	return p->cur.stage;
+}
+
+// Share of the heater demand a channel gets in the current stage, out of 255
+uint8_t profile_split(const profile_t *p, uint8_t ch) {
+	if(!p->split || p->cur.stage>=STAGE_COUNT) return 0xFF;
+	return pgm_read_byte(&p->split[p->cur.stage*POWER_CHANNELS+ch]);
+}
+
+PGM_P profile_stage_name(uint8_t stage) {
+	return (PGM_P)pgm_read_word(&stage_names[stage]);
+}
@@ -0,0 +1,115 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <avr/pgmspace.h>
+
+#include "power.h"
+
+/* Setpoint interpolation within a segment */
+#define PROFILE_INTERP_LINEAR		0
+#define PROFILE_INTERP_SPLINE		1		// Monotone cubic, never overshoots a point
+
+/* Setpoint generator configuration */
+#define PROFILE_INTERP					PROFILE_INTERP_SPLINE
+#define PROFILE_MAX_RAMP				3		// Degrees per second, 0 for no limit
+#define PROFILE_MAX_SEGMENTS		8
+#define PROFILE_HOLD_MAX				120	// Longest a condition may hold a segment, seconds
+#define PROFILE_TAL_COOL_RATE		15	// Expected fall to liquidus after peak, degrees/10s
+
+/* Thermal load detection */
+#define LOAD_START_RISE					10	// Start measuring this far above the start temp
+#define LOAD_MIN_DUTY_MS				5000	// Full-power time needed for an estimate
+#define LOAD_REF_RATE						20	// Empty-oven rise at full power, degrees/10s
+#define LOAD_SCALE_MIN					192	// Shortest time scale, Q8 (x0.75)
+#define LOAD_SCALE_MAX					384	// Longest time scale, Q8 (x1.5)
+
+/* Segment position is evaluated as a Q14 fraction of its length */
+#define PROFILE_U_BITS					14
+
+/* Stage IDs, in the same order as the STAT_PROFILE_* flags */
+#define STAGE_PREHEAT						0
+#define STAGE_SOAK							1
+#define STAGE_RAMPUP						2
+#define STAGE_PEAK							3
+#define STAGE_RAMPDOWN					4
+#define STAGE_COUNT							5
+
+/* Segment conditions */
+#define SEG_HOLD_UNTIL					(1<<0)	// Hold the end until T >= cond_temp
+#define SEG_HOLD_ABOVE					(1<<1)	// Hold until cond_secs spent above cond_temp
+#define SEG_MAX_RAMP						(1<<2)	// Limit the setpoint ramp to ramp/10 degrees/s
+
+// One profile segment, as stored in program memory
+typedef struct {
+	uint16_t secs;				// Nominal duration
+	uint16_t temp;				// Temperature at the end of the segment
+	uint8_t stage;				// Stage ID, also the index of its name
+	uint8_t flags;				// SEG_* conditions
+	uint16_t cond_temp;		// Temperature for SEG_HOLD_UNTIL and SEG_HOLD_ABOVE
+	uint8_t cond_secs;		// Seconds for SEG_HOLD_ABOVE
+	uint8_t ramp;					// Tenths of a degree per second for SEG_MAX_RAMP
+} profseg_t;
+
+// A variable-length profile, as stored in program memory
+typedef struct {
+	uint16_t starttemp;
+	uint16_t liquidus;		// Solder liquidus, 0 to disable the TAL guard
+	uint8_t tal_min;			// Target time above liquidus window, seconds
+	uint8_t tal_max;
+	uint8_t count;
+	const profseg_t *segs;
+	const uint8_t *split;	// STAGE_COUNT rows of POWER_CHANNELS shares, or NULL
+} profdef_t;
+
+// One segment as a cubic in its normalised position u:
+// y = y0 + u*(c1 + u*(c2 + u*c3))
+typedef struct {
+	uint32_t len;					// Nominal length in milliseconds
+	uint32_t k;						// Scale from elapsed ms to u, Q31 over segment length
+	int16_t y0;						// Fixed-point degrees
+	int32_t c1;
+	int32_t c2;
+	int32_t c3;
+} segment_t;
+
+typedef struct {
+	uint8_t count;
+	segment_t seg[PROFILE_MAX_SEGMENTS];
+	const profseg_t *segs;
+	const uint8_t *split;
+	// Engine state
+	uint8_t index;				// Current segment
+	profseg_t cur;				// Its definition
+	uint32_t elapsed;			// Time spent in it, ms
+	uint32_t above;				// Time spent above cond_temp in it, ms
+	int32_t ramped;				// Ramp-limited setpoint, Q8 fixed-point degrees
+	bool done;
+	// Time above liquidus guard
+	int16_t liquidus;			// Fixed-point degrees
+	uint32_t tal_target;	// Centre of the TAL window, ms
+	uint32_t tal;					// Time spent above liquidus this run, ms
+	int16_t peak;					// Highest temperature reached this run
+	// Thermal load detection
+	int16_t load_from;		// Temperature at the start of the run
+	int16_t load_start;		// Temperature when measuring began, INT16_MIN before
+	uint32_t load_duty;		// Heater time at full power since then, ms
+	uint16_t load_rem;		// Part of a ms carried over, per-mille ms
+	uint16_t load_ref;		// Empty-oven rise at full power, fixed-point degrees/s
+	uint16_t load_scale;	// Time scale applied to the later segments, Q8
+} profile_t;
+
+void profile_load(profile_t *p, const profdef_t *def);
+void profile_load_reference(profile_t *p, uint16_t rate);
+void profile_warm_start(profile_t *p, int16_t measured);
+void profile_resume(profile_t *p, int16_t measured);
+void profile_restore(profile_t *p, uint8_t index, uint32_t elapsed, uint32_t tal,
+										 int16_t peak, uint16_t load_scale);
+int16_t profile_step(profile_t *p, uint16_t dt_ms, int16_t measured, uint16_t demand);
+int16_t profile_peek(const profile_t *p, uint32_t ahead_ms);
+uint8_t profile_stage(const profile_t *p);
+uint8_t profile_split(const profile_t *p, uint8_t ch);
+PGM_P profile_stage_name(uint8_t stage);
+
+#endif // PROFILE_H
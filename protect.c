@@ -0,0 +1,70 @@
+#include "globals.h"
+#include "pid.h"
+#include "protect.h"
+
+// Heater protection. The commanded power is checked against what the
+// thermocouple sees over a sliding window of PROTECT_WINDOW seconds. A
+// rise while the heater has been off for longer than the oven could coast
+// means it is heating without being asked to (a welded SSR); no rise at
+// full power means the heat isn't reaching the thermocouple (an open
+// element, or a thermocouple off the board). Either fault latches until
+// reset. Each control step only adds to a sum; the checks run once a second.
+// Control steps keep coming with the oven idle, at zero demand, so a welded
+// SSR is caught whether or not anything has asked for heat.
+
+void protect_init(protect_t *p, uint16_t dt_ms) {
+	p->steps = 1000/dt_ms;
+	protect_reset(p);
+}
+
+void protect_reset(protect_t *p) {
+	p->head = p->filled = 0;
+	p->dsum = 0;
+	p->ticks = 0;
+	p->off_secs = p->full_secs = 0;
+	p->fault = PROTECT_OK;
+}
+
+uint8_t protect_update(protect_t *p, int16_t measured, uint16_t demand, const ovenmodel_t *m) {
+	if(p->fault) return p->fault;
+	p->dsum += demand;
+	if(++p->ticks<p->steps) return PROTECT_OK;
+	
+	// A second has passed: judge the heater on its average demand over it
+	uint16_t mean = p->dsum/p->ticks;
+	p->dsum = 0;
+	p->ticks = 0;
+	if(mean)													p->off_secs = 0;
+	else if(p->off_secs<UINT16_MAX)		p->off_secs++;
+	if(mean<PROTECT_FULL_DUTY)				p->full_secs = 0;
+	else if(p->full_secs<UINT16_MAX)	p->full_secs++;
+	
+	// Rise across the window, once there's a full window of it
+	int16_t oldest = p->temp[p->head];
+	p->temp[p->head] = measured;
+	if(++p->head>=PROTECT_WINDOW) p->head = 0;
+	if(p->filled<PROTECT_WINDOW) {
+		p->filled++;
+		return PROTECT_OK;
+	}
+	int16_t rise = measured-oldest;
+	
+	// With a model the coast is a few dead times, however long that is;
+	// without one, a typical oven's
+	uint32_t coast = PROTECT_COAST;
+	if(m) coast = (3UL*m->deadtime<PROTECT_COAST_MIN)?PROTECT_COAST_MIN:3UL*m->deadtime;
+	
+	if(p->off_secs>=coast+PROTECT_WINDOW && rise>=TEMP_FX(PROTECT_RUNAWAY_RISE))
+		p->fault = PROTECT_RUNAWAY;
+	
+	if(p->full_secs>=coast+PROTECT_WINDOW && rise<TEMP_FX(PROTECT_MIN_RISE)) {
+		// Close to the most the oven can reach, a small rise is all there is
+		bool expected = true;
+		if(m && m->tau) {
+			int32_t room = ((int32_t)m->gain<<TEMP_FRAC_BITS)+m->ambient-measured;
+			expected = (room*PROTECT_WINDOW/m->tau>=2*TEMP_FX(PROTECT_MIN_RISE));
+		}
+		if(expected) p->fault = PROTECT_INEFFECTIVE;
+	}
+	return p->fault;
+}
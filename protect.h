@@ -0,0 +1,41 @@
+#ifndef PROTECT_H
+#define PROTECT_H
+
+#include <inttypes.h>
+
+#include "model.h"
+
+/* Heater protection settings */
+#define PROTECT_WINDOW				5				// Seconds of history compared, up to 32
+#define PROTECT_COAST					10			// Seconds the oven may coast on after a change, without a model
+#define PROTECT_COAST_MIN			4				// Shortest coast, however quick the model says it is
+#define PROTECT_RUNAWAY_RISE	3				// Rise over the window with the heater off
+#define PROTECT_MIN_RISE			1				// Least rise over the window at full power
+#define PROTECT_FULL_DUTY			900			// Demand counted as full power, per-mille
+
+#if PROTECT_WINDOW > 32
+	#error "Protection window must be 32s or less"
+#endif
+
+/* Faults */
+#define PROTECT_OK						0
+#define PROTECT_RUNAWAY				1				// Heating with the heater off
+#define PROTECT_INEFFECTIVE		2				// Not heating at full power
+
+typedef struct {
+	int16_t temp[PROTECT_WINDOW];	// Reading at the end of each second
+	uint8_t head;
+	uint8_t filled;
+	uint32_t dsum;					// Demand summed over the current second
+	uint16_t ticks;
+	uint16_t steps;					// Control steps per second
+	uint16_t off_secs;			// Seconds since the heater last had any demand
+	uint16_t full_secs;			// Seconds the heater has been at full power
+	uint8_t fault;
+} protect_t;
+
+void protect_init(protect_t *p, uint16_t dt_ms);
+void protect_reset(protect_t *p);
+uint8_t protect_update(protect_t *p, int16_t measured, uint16_t demand, const ovenmodel_t *m);
+
+#endif // PROTECT_H
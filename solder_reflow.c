@@ -4,15 +4,80 @@
 
 
 
-// The temperature/time profile as {secs, temp}
-// This profile is linearly interpolated to get the required temperature at any time.
-#define PROFILE_LENGTH 6
-#define PROFILE_DATLEN 2
-uint16_t profile_pb[PROFILE_LENGTH][PROFILE_DATLEN] PROGMEM =
-	{ {0, 20}, {60, 120}, {150, 130}, {220, 185}, {240, 195}, {300, 20} };
-uint16_t profile_rohs[PROFILE_LENGTH][PROFILE_DATLEN] PROGMEM =
-	{ {0, 20}, {60, 180}, {150, 190}, {220, 220}, {240, 230}, {300, 20} };
-uint16_t *activeprofile;
+// The temperature/time profiles, as {start temp, liquidus, TAL min, TAL max}
+// followed by segments of
+// {secs, temp, stage, conditions, condition temp, condition secs, ramp/10}
+static const profseg_t profile_pb_segs[] PROGMEM = {
+	{  60, 120, STAGE_PREHEAT,	SEG_HOLD_UNTIL, 110,  0, 0 },
+	{  90, 130, STAGE_SOAK,			0,								0,  0, 0 },
+	{  70, 185, STAGE_RAMPUP,		0,								0,  0, 0 },
+	{  20, 195, STAGE_PEAK,			0,								0,  0, 0 },
+	{  60,  20, STAGE_RAMPDOWN,	0,								0,  0, 0 } };
+static const profseg_t profile_rohs_segs[] PROGMEM = {
+	{  60, 180, STAGE_PREHEAT,	SEG_HOLD_UNTIL, 170,  0, 0 },
+	{  90, 190, STAGE_SOAK,			0,								0,  0, 0 },
+	{  70, 220, STAGE_RAMPUP,		0,								0,  0, 0 },
+	{  20, 230, STAGE_PEAK,			0,								0,  0, 0 },
+	{  60,  20, STAGE_RAMPDOWN,	0,								0,  0, 0 } };
+
+// Share of the heater demand given to each channel in each stage, out of 255.
+// The bottom elements carry the soak, so the board heats through from below,
+// and the top elements lead at peak to reflow the joints.
+#if POWER_CHANNELS == 2
+static const uint8_t heater_split[STAGE_COUNT*POWER_CHANNELS] PROGMEM = {
+	// Top	Bottom
+	0xFF,	0xFF,		// Preheat
+	0xA0,	0xFF,		// Soak
+	0xFF,	0xFF,		// Ramp-up
+	0xFF,	0xA0,		// Peak
+	0xFF,	0xFF };	// Ramp-down
+#define PROFILE_SPLIT	heater_split
+#else
+#define PROFILE_SPLIT	0
+#endif
+
+#define PROFILE_SEGS(p)	(sizeof(p)/sizeof(profseg_t))
+static const profdef_t profiles[] PROGMEM = {
+	{ 20, 183, 45, 75, PROFILE_SEGS(profile_pb_segs), profile_pb_segs, PROFILE_SPLIT },
+	{ 20, 217, 45, 75, PROFILE_SEGS(profile_rohs_segs), profile_rohs_segs, PROFILE_SPLIT } };
+const profdef_t *activeprofile;
+
+// Boards per batch, in the order of the batch size menu
+static const uint8_t batch_sizes[] PROGMEM = { 2, 5, 10, 20 };
+
+// Thermocouple filter stages, in the order of the sensor filter menu
+static const uint8_t filter_presets[] PROGMEM = {
+	FILTER_BOX,
+	FILTER_MEDIAN_3|FILTER_BOX,
+	FILTER_MEDIAN_5|FILTER_BOX|FILTER_IIR_SHIFT(3),
+	FILTER_MEDIAN_5|FILTER_BOX|FILTER_IIR_SHIFT(5) };
+
+// ADC inputs of the thermocouple channels
+static const uint8_t tc_mux[TC_CHANNELS] PROGMEM = TC_MUX_LIST;
+
+// Channel weights for control, in the order of the control probe menu. With
+// only the air probe fitted every choice falls back to it.
+#if TC_CHANNELS == 2
+static const uint8_t tc_mixes[][TC_CHANNELS] PROGMEM = {
+	{ 128, 0 },			// Oven air
+	{ 0, 128 },			// Board surface
+	{ 64, 64 } };		// Both
+#else
+static const uint8_t tc_mixes[][TC_CHANNELS] PROGMEM = {
+	{ 128 } };			// Oven air
+#endif
+
+// The watchdog stays enabled through a reset it caused, so it has to be
+// stopped before the C runtime gets going; the reset flags are kept for main
+static uint8_t mcusr_mirror __attribute__((section(".noinit")));
+void wdt_init(void) __attribute__((naked)) __attribute__((section(".init3")));
+void wdt_init(void)
+{
+	HEAT_DISABLE;
+	mcusr_mirror = MCUSR;
+	MCUSR = 0;
+	wdt_disable();
+}
 
 
 
@@ -32,10 +97,24 @@ int main(void)
 	DDRD |= (1<<3);
 	PORTD &= ~(1<<3);
 	
-	// Configure pin D4 (heating elements) as output
+	// Configure pin D4 (top heating elements) as output
 	DDRD |= (1<<4);
 	PORTD &= ~(1<<4);
 	
+#if POWER_CHANNELS > 1
+	// Configure pin B1 (bottom heating elements) as output
+	DDRB |= (1<<1);
+	PORTB &= ~(1<<1);
+#endif
+	
+#if POWER_ZC == POWER_ZC_INPUT
+	// Configure pin B0 (mains zero-crossing detector) as input with pull-up
+	DDRB &= ~(1<<0);
+	PORTB |= (1<<0);
+	PCMSK0 |= (1<<PCINT0);
+	PCICR |= (1<<PCIE0);
+#endif
+	
 	// Configure pin D5-7 (rotary encoder and button) as input with pull-ups
 	DDRD &= ~((1<<7)|(1<<6)|(1<<5));
 	PORTD |= ((1<<7)|(1<<6)|(1<<5));
@@ -43,72 +122,128 @@ int main(void)
 	// Initialise the LCD display
 	lcd_init();
 	
-	// Enable pin change interrupts for door switch and rotary encoder
-	PCMSK2 |= ((1<<PCINT7)|(1<<PCINT6)|	// Enable interrupt on D2 and D5-7
-						(1<<PCINT5)|(1<<PCINT2));
+	// Enable pin change interrupts for the rotary encoder and button
+	PCMSK2 |= ((1<<PCINT7)|(1<<PCINT6)|	// Enable interrupt on D5-7
+						(1<<PCINT5));
 	INPUT_ENABLE;
 	
+	// The door switch gets INT0 to itself, the highest priority interrupt
+	EICRA |= (1<<ISC00);								// Any change on D2
+	if(PIND&(1<<2)) GPIOR0 |= (1<<DOOR_EVENT);
+	DOOR_ENABLE;
+	
+	// Configure the thermocouple pins as inputs without pull-ups, and turn off
+	// their digital input buffers so the analog voltage doesn't draw current
+	for(uint8_t i=0; i<TC_CHANNELS; i++) {
+		uint8_t pin = pgm_read_byte(&tc_mux[i]);
+		DDRC &= ~(1<<pin);
+		PORTC &= ~(1<<pin);
+		DIDR0 |= (1<<pin);
+	}
+	
 	// Configure ADC for temperature readings
-	ADMUX &= ~((1<<MUX3)|(1<<MUX2)|			// Clear MUX
-		(1<<MUX1)|(1<<MUX0));
-	ADMUX |= (1<<REFS0);								// Internal Vcc as reference
-	ADCSRB &= ~((1<<ADTS2)|(1<<ADTS1)|	// Free-running Mode
-		(1<<ADTS0));
+	ADC_SELECT(pgm_read_byte(&tc_mux[0]));	// Start of the scan
+	ADMUX |= (1<<REFS0);								// AVcc as reference, tracked against the bandgap
 	ADCSRA |= ((1<<ADPS2)|(1<<ADPS1)|		// Clock/128
 		(1<<ADPS0));
-	ADCSRA |= ((1<<ADEN)|(1<<ADATE));		// Enable ADC, auto-trigger
+	ADCSRA |= (1<<ADEN);								// Enable ADC, conversions started by the tick
 	
 	// Configure timer interrupt for debounce and cancel delay
 	TCCR0A |= (1<<WGM01);								// CTC
 	TCCR0B |= ((1<<CS02)|(1<<CS00));		// Clock/128
 	OCR0A = 0xFF;												// 0.00204s at 16MHz / 128
 	
-	// Configure timer interrupt for the temperature reporter and piezo buzzer
+	// Configure timer interrupt for the system tick (sampling, control, display and buzzer)
 	TCCR1B |= (1<<WGM12);								// CTC mode (clear timer on compare match)
-	TCCR1B |= (1<<CS12);								// Clock/256
-	OCR1A = 3125;												// 0.05s at 16MHz / 256
+	TCCR1B |= ((1<<CS11)|(1<<CS10));		// Clock/64
+	OCR1A = (F_CPU/64/1000)*TICK_MS-1;	// 0.001s at 16MHz / 64
+	TICK_ENABLE;
+	power_init(TICK_MS);
+	est_init(&est, RATE_CONTROL*TICK_MS);
+	cool_init(&cool, RATE_CONTROL*TICK_MS);
+	protect_init(&prot, RATE_CONTROL*TICK_MS);
+	supply_init(&supply);
 	
-	// Configure PWM for the piezo buzzer
+	// Configure PWM for the piezo buzzer and the cooling fan (OC2A, PB3)
 	TCCR2A |= ((1<<WGM21)|(1<<WGM20));
 	TCCR2B |= (1<<CS20);
 	
 	// Load settings from EEPROM and initialise if necessary
 	EEPROM_LOAD();
 	if(EEPROM_UNINIT())	EEPROM_CLRALL();
+	load_pid_gains();
+	load_oven_model();
+	load_filter();
+	load_probe_mix();
+	cal_load(EEPROM_CAL_ADDR);
+	uint8_t cause = record_reset_cause();
 	
 	// Enable interrupts
 	sei();
 	
 	lcd_write_cgram_defaults();
 	
+	// Say why we restarted if it wasn't a normal power-up or reset button
+	if(cause==RESET_WATCHDOG || cause==RESET_BROWNOUT) show_reset_cause(cause);
+	
+	// From here on the tick and the main loop must both keep checking in
+	WDT_CHECKIN(MAIN);
+	wdt_enable(WDT_TIMEOUT);
+	
+	// Look for a run that was cut short by a reset
+	bool interrupted = checkpoint_load(EEPROM_CHECKPOINT_ADDR, &resumecp);
+	
 	// Check if door switch is high (door is open)
 	if(PIND&(1<<2)) {
 		STAT_SET(DOOR_OPEN);
 	// If not, reset to a known state
 	} else {
 		reset_all();
+		if(interrupted && offer_resume()) MENU_SET(RESUME);
+		interrupted = false;
 	}
 	
 	while(1) {
+		WDT_CHECKIN(MAIN);
 		
-		if(STAT(DOOR_OPEN)|STAT(TC_ERROR)) {
+		if(STAT(FAULT)) {
+			// Latched until the power is cycled, so nothing can start heating
+			// again on a heater that can't be trusted; the tick keeps it off
+			start_buzzer(3,BUZZER_TIME_DOOR_TC_ERROR);
+			checkpoint_clear(EEPROM_CHECKPOINT_ADDR);
+			show_heater_fault();
+			while(1) WDT_CHECKIN(MAIN);
+		} else if(STAT(DOOR_OPEN)|STAT(TC_ERROR)) {
+			// Opening the door to unload is how a batch moves on to its next run;
+			// anything else ends the batch
+			bool batchnext = (batchstate==BATCH_UNLOAD || batchstate==BATCH_COOLING) &&
+											 !STAT(TC_ERROR);
 			start_buzzer(1,BUZZER_TIME_DOOR_TC_ERROR);
+			// Give a run the chance to carry on if the door is only opened briefly
+			if(STAT(DOOR_OPEN) && !STAT(TC_ERROR) && STAT(PROFILE_RUNNING) &&
+				 !STAT(PROFILE_COMPLETE) && !STAT(PROFILE_CANCEL) && pause_profile())
+				continue;
 			if(STAT(TC_ERROR)) {
 				show_thermocouple_error();
-				while(STAT(TC_ERROR)){};
+				while(STAT(TC_ERROR)) WDT_CHECKIN(MAIN);
 			} else if(STAT(DOOR_OPEN)) {
 				show_door_open();
-				while(STAT(DOOR_OPEN)){};
+				while(STAT(DOOR_OPEN)) WDT_CHECKIN(MAIN);
 			}
 			if(STAT(DOOR_OPEN)|STAT(TC_ERROR)) continue;
 			reset_all();
+			if(batchnext) start_batch_cooling();
+			// Powered up with the door open: the interrupted run is offered now
+			if(interrupted && offer_resume()) MENU_SET(RESUME);
+			interrupted = false;
 		} else {
 			/* If there is an ISR flag, check which ones are set */
 			if(isrflags) {
 				
 				/* If we need to report the temperature */
 				if(ISRF(REPORT_TEMP)) {
-					show_temp_report();
+					if(STAT(CALIBRATE))	show_calibrate_state();
+					else								show_temp_report();
 				}
 				
 				/* If we need to respond to button presses */
@@ -123,20 +258,15 @@ int main(void)
 								switch(sel) {
 									case 0:									// Leaded Profile
 									case 1:									// RoHS Profile
-										if(activeprofile) free(activeprofile);
-										activeprofile = malloc(sizeof(uint16_t)*PROFILE_LENGTH*PROFILE_DATLEN);
-										if(activeprofile) {
-											MENU_CLR();
-											memcpy_P(activeprofile,(sel==1?profile_rohs:profile_pb),sizeof(uint16_t)*PROFILE_LENGTH*PROFILE_DATLEN);
-											TEMPREP_BUZZ_ENABLE;
-											ADC_ENABLE;
-											STAT_SET(PROFILE_RUNNING);
-										}
+										if(start_profile(sel, 0)) MENU_CLR();
 										break;
-									case 2:									// Settings Menu
+									case 2:									// Batch Run Menu
+										MENU_SET(BATCH);
+										break;
+									case 3:									// Settings Menu
 										MENU_SET(SETTINGS);
 										break;
-									case 3:									// About Software
+									case 4:									// About Software
 										MENU_CLR();
 										STAT_SET(ABOUT);
 										break;
@@ -144,6 +274,35 @@ int main(void)
 										MENU_CLR();
 										STAT_SET(COMING_SOON);
 								}
+							} else if(MENU(BATCH)) {
+								uint8_t sel = menu_selected();
+								if(sel) {
+									batchprofile = sel-1;
+									MENU_SET(BATCHCOUNT);
+								} else {
+									MENU_SET(MAIN);
+								}
+							} else if(MENU(BATCHCOUNT)) {
+								uint8_t sel = menu_selected();
+								if(!sel) {
+									MENU_SET(BATCH);
+								} else if(start_profile(batchprofile, 0)) {
+									batchcount = pgm_read_byte(&batch_sizes[sel-1]);
+									batchrun = 0;
+									batchstate = BATCH_RUNNING;
+									MENU_CLR();
+								}
+							} else if(MENU(RESUME)) {
+								if(menu_selected()==0 && start_profile(resumecp.profile, &resumecp)) {
+									batchprofile = resumecp.profile;
+									batchcount = resumecp.batchcount;
+									batchrun = resumecp.batchrun;
+									batchstate = batchcount?BATCH_RUNNING:BATCH_IDLE;
+									MENU_CLR();
+								} else {
+									if(menu_selected()) checkpoint_clear(EEPROM_CHECKPOINT_ADDR);
+									MENU_SET(MAIN);
+								}
 							} else if(MENU(SETTINGS)) {
 								switch(menu_selected()) {
 									case 0:
@@ -155,6 +314,26 @@ int main(void)
 									case 2:
 										MENU_SET(SOUNDS);
 										break;
+									case 3:
+										MENU_SET(STANDBY);
+										break;
+									case 4:
+										MENU_CLR();
+										start_autotune();
+										break;
+									case 5:
+										MENU_CLR();
+										start_characterize();
+										break;
+									case 6:
+										MENU_SET(CALIBRATE);
+										break;
+									case 7:
+										MENU_SET(FILTER);
+										break;
+									case 8:
+										MENU_SET(PROBE);
+										break;
 								}
 							} else if(MENU(UNITS)) {
 								EEPROM_CLR(TEMPERATURE);	// Celsius
@@ -174,10 +353,58 @@ int main(void)
 										break;
 								}
 								MENU_SET(SETTINGS);
+							} else if(MENU(STANDBY)) {
+								EEPROM_CLR(STANDBY);
+								switch(menu_selected()) {
+									case 1:
+										EEPROM_SET(STANDBY_LOW);
+										break;
+									case 2:
+										EEPROM_SET(STANDBY_MED);
+										break;
+									case 3:
+										EEPROM_SET(STANDBY_HIGH);
+										break;
+								}
+								stop_standby();		// Restarted at the new temperature below
+								MENU_SET(SETTINGS);
+							} else if(MENU(CALIBRATE)) {
+								switch(menu_selected()) {
+									case 0:
+										MENU_SET(SETTINGS);
+										break;
+									case 1:
+										start_calibrate(CAL_LOW);
+										break;
+									case 2:
+										start_calibrate(CAL_HIGH);
+										break;
+									case 3:
+										cal_reset(EEPROM_CAL_ADDR);
+										MENU_SET(SETTINGS);
+										break;
+								}
+							} else if(MENU(FILTER)) {
+								uint8_t config = pgm_read_byte(&filter_presets[menu_selected()]);
+								eeprom_update_byte(EEPROM_FILTER_ADDR, config);
+								for(uint8_t i=0; i<TC_CHANNELS; i++)
+									filter_configure(&tcfilter[i], config);
+								cli();
+								est_set_delay(&est, filter_delay_ms(config));
+								sei();
+								MENU_SET(SETTINGS);
+							} else if(MENU(PROBE)) {
+								eeprom_update_byte(EEPROM_PROBE_ADDR, menu_selected());
+								load_probe_mix();
+								MENU_SET(SETTINGS);
 							}
+						} else if(STAT(CALIBRATE)) {
+							finish_calibrate();
 						} else if(STAT(PROFILE_COMPLETE) ||
 											STAT(PROFILE_CANCEL) ||
-											STAT(TC_ERROR)) {
+											STAT(TC_ERROR) ||
+											STAT_TUNING() ||
+											batchstate==BATCH_COOLING) {
 							reset_all();
 						} else if(STAT(ABOUT)) {
 							MENU_SET(MAIN);
@@ -199,6 +426,9 @@ int main(void)
 						if(MENU_ANY()) {
 							menu_next();
 							start_buzzer(1,BUZZER_TIME_MENU);
+						} else if(STAT(CALIBRATE) && calref<CALIBRATE_REF_MAX) {
+							calref++;
+							ISRF_SET(REPORT_TEMP);
 						}
 					}
 					
@@ -206,6 +436,9 @@ int main(void)
 						if(MENU_ANY()) {
 							menu_prev();
 							start_buzzer(1,BUZZER_TIME_MENU);
+						} else if(STAT(CALIBRATE) && calref>0) {
+							calref--;
+							ISRF_SET(REPORT_TEMP);
 						}
 					}
 					
@@ -216,9 +449,17 @@ int main(void)
 			
 			if(MENU_ANY()) {
 				show_menu();
+				// Hold the oven warm between runs if asked to
+				if(EEPROM(STANDBY) && !STAT(STANDBY)) start_standby();
 			} else {
 				menu_uninit();
 				
+				if(batchstate==BATCH_COOLING) {
+					update_batch();
+				}
+				if(STAT(SAFE_OPEN) && !safe_shown && !STAT(PROFILE_RUNNING)) {
+					show_safe_to_open();
+				}
 				if(STAT(PROFILE_COMPLETE) ||
 					 STAT(PROFILE_CANCEL) ||
 					 STAT(TC_ERROR)) {
@@ -227,6 +468,8 @@ int main(void)
 				if(STAT(PROFILE_RUNNING)) {
 					if(STAT(CANCEL))	show_cancel_timer();
 					else							reset_cancel_timer();
+					if(activeprofile && !STAT(PROFILE_COMPLETE) && !STAT(PROFILE_CANCEL))
+						update_checkpoint();
 				}
 				if(STAT(ABOUT)) {
 					show_about();
@@ -234,6 +477,12 @@ int main(void)
 				if(STAT(COMING_SOON)) {
 					show_coming_soon();
 				}
+				if(STAT(AUTOTUNE)) {
+					show_autotune_state();
+				}
+				if(STAT(CHARACTERIZE)) {
+					show_characterize_state();
+				}
 			}
 		}
 	}
@@ -241,63 +490,71 @@ int main(void)
 
 
 
-static inline void show_temp_report(void)
+static inline double convert_temp(double c, char *tempsymbol)
 {
-	/* Display current profile step as necessary */
-	if(STAT(PROFILE_RUNNING) && !STAT(PROFILE_CANCEL)) {
-		show_profile_state();
-	}
-	char buf[LCD_DISP_LENGTH];
-	uint16_t convertedtemp;
-	double convertedtarget;
-	char tempsymbol[4];
 	switch(EEPROM(TEMPERATURE)) {
 		case EEPROM_FAHRENHEIT:
-			convertedtemp = ctof(temperature);
-			convertedtarget = ctof(targettemp);
 			strcpy_P(tempsymbol, fsymbol);
-			break;
+			return ctof(c);
 		case EEPROM_KELVIN:
-			convertedtemp = ctok(temperature);
-			convertedtarget = ctok(targettemp);
 			strcpy_P(tempsymbol, ksymbol);
-			break;
+			return ctok(c);
 		case EEPROM_RANKINE:
-			convertedtemp = ctor(temperature);
-			convertedtarget = ctor(targettemp);
 			strcpy_P(tempsymbol, rsymbol);
-			break;
+			return ctor(c);
 		case EEPROM_DELISLE:
-			convertedtemp = ctod(temperature);
-			convertedtarget = ctod(targettemp);
 			strcpy_P(tempsymbol, dsymbol);
-			break;
+			return ctod(c);
 		case EEPROM_NEWTON:
-			convertedtemp = cton(temperature);
-			convertedtarget = cton(targettemp);
 			strcpy_P(tempsymbol, nsymbol);
-			break;
+			return cton(c);
 		case EEPROM_REAUMUR:
-			convertedtemp = ctore(temperature);
-			convertedtarget = ctore(targettemp);
 			strcpy_P(tempsymbol, resymbol);
-			break;
+			return ctore(c);
 		case EEPROM_ROMER:
-			convertedtemp = ctoro(temperature);
-			convertedtarget = ctoro(targettemp);
 			strcpy_P(tempsymbol, rosymbol);
-			break;
+			return ctoro(c);
 		default:	// Celsius
-			convertedtemp = temperature;
-			convertedtarget = targettemp;
 			strcpy_P(tempsymbol, csymbol);
+			return c;
+	}
+}
+
+static inline void show_temp_report(void)
+{
+	/* Display current profile step as necessary */
+	if(STAT(PROFILE_RUNNING) && !STAT(PROFILE_CANCEL)) {
+		show_profile_state();
+	}
+	char buf[LCD_DISP_LENGTH+1];
+	char tempsymbol[4];
+	uint16_t convertedtemp = convert_temp(temperature, tempsymbol);
+	double convertedtarget = convert_temp(targettemp/(double)(1<<TEMP_FRAC_BITS), tempsymbol);
+	// Warn about a flaky thermocouple before it turns into an error, and put
+	// back what the warning covered once it has settled
+	if(STAT(TC_FLAKY) && !STAT(CANCEL)) {
+		lcd_set_cursor(2,1);
+		lcd_print_p(checktcmsg);
+		flaky_shown = true;
+	} else if(flaky_shown && !STAT(CANCEL)) {
+		lcd_clrline(2);
+		if(batchstate==BATCH_COOLING) {
+			double restart = convert_temp(BATCH_RESTART_TEMP, tempsymbol);
+			sprintf_P(buf, batchcoolingmsg, restart, tempsymbol);
+			lcd_set_cursor(2,1);
+			lcd_print(buf);
+		}
+		flaky_shown = false;
 	}
 	sprintf_P(buf, tempmsg, convertedtemp, tempsymbol);
 	lcd_set_cursor(3,3);
 	lcd_print(buf);
-	sprintf_P(buf, targetmsg, convertedtarget, tempsymbol);
-	lcd_set_cursor(4,1);
-	lcd_print(buf);
+	// The last run's result stays on line 4 while a batch cools
+	if(batchstate!=BATCH_COOLING) {
+		sprintf_P(buf, targetmsg, convertedtarget, tempsymbol);
+		lcd_set_cursor(4,1);
+		lcd_print(buf);
+	}
 	
 	ISRF_CLR(REPORT_TEMP);
 }
@@ -317,6 +574,27 @@ static inline void show_menu(void)
 		case MENU_SOUNDS:
 			menu_init(sounds);
 			break;
+		case MENU_STANDBY:
+			menu_init(standby);
+			break;
+		case MENU_BATCH:
+			menu_init(batch);
+			break;
+		case MENU_BATCHCOUNT:
+			menu_init(batchcount);
+			break;
+		case MENU_RESUME:
+			menu_init(resume);
+			break;
+		case MENU_CALIBRATE:
+			menu_init(calibrate);
+			break;
+		case MENU_FILTER:
+			menu_init(filter);
+			break;
+		case MENU_PROBE:
+			menu_init(probe);
+			break;
 	}
 }
 
@@ -338,6 +616,42 @@ static inline void show_door_open(void)
 	lcd_print_p(pleaseclosedoormsg);
 }
 
+static inline void show_run_paused(uint8_t secs)
+{
+	char buf[LCD_DISP_LENGTH+1];
+	sprintf_P(buf, resumewithinmsg, secs);
+	lcd_set_cursor(3,3);
+	lcd_print(buf);
+}
+
+static inline void show_heater_fault(void)
+{
+	lcd_clrscr();
+	lcd_set_cursor(1,1);
+	lcd_print_p((prot.fault==PROTECT_RUNAWAY)?runawaymsg:ineffectivemsg);
+	lcd_set_cursor(2,1);
+	lcd_print_p(heatershutdownmsg);
+	lcd_set_cursor(4,1);
+	lcd_print_p(powercyclemsg);
+}
+
+static inline void show_reset_cause(uint8_t cause)
+{
+	char buf[LCD_DISP_LENGTH+1];
+	lcd_clrscr();
+	lcd_set_cursor(1,1);
+	lcd_print_p((cause==RESET_WATCHDOG)?watchdogresetmsg:brownoutresetmsg);
+	sprintf_P(buf, resetcountmsg, eeprom_read_byte(EEPROM_WDTCOUNT_ADDR));
+	lcd_set_cursor(2,1);
+	lcd_print(buf);
+	lcd_set_cursor(4,1);
+	lcd_print_p(presstocontinuemsg);
+	ISRF_CLRBTN();
+	while(!(ISRF(ENTER) && !DEBOUNCE_ENABLED)){};
+	ISRF_CLRBTN();
+	lcd_clrscr();
+}
+
 static inline void show_cancel_timer(void)
 {
 	// if(ctovf_count >= 155) {	// 155 = 2.5s
@@ -363,62 +677,28 @@ static inline void show_cancel_timer(void)
 
 static inline void show_profile_state(void)
 {
-	uint16_t time_sec = time_ms/1000;
-	uint8_t i = PROFILE_LENGTH;
-	if(time_sec <= *activeprofile && !STAT(PROFILE_PREHEAT)) {
+	// Stage IDs follow the order of the STAT_PROFILE_* flags
+	uint8_t stage = profile_stage(&setpoints);
+	if(!(statusflags&(1UL<<(STAT_PROFILE_PREHEAT+stage)))) {
+		PGM_P name = profile_stage_name(stage);
+		STAT_SETPFSTAGE(stage);
 		lcd_clrline(1);
-		lcd_set_cursor(1,7);
-		lcd_print_P("Preheat");
-		STAT_SET(PROFILE_PREHEAT);
-	} else {
-		while(--i) {
-			if(time_sec <= *(activeprofile+(i*PROFILE_DATLEN)) &&
-				 time_sec > *(activeprofile+((i-1)*PROFILE_DATLEN))) {
-				switch(i) {
-					case 2:
-						if(!STAT(PROFILE_SOAK)) {
-							lcd_clrline(1);
-							lcd_set_cursor(1,9);
-							lcd_print_P("Soak");
-							STAT_SET(PROFILE_SOAK);
-						}
-						break;
-					case 3:
-						if(!STAT(PROFILE_RAMPUP)) {
-							lcd_clrline(1);
-							lcd_set_cursor(1,7);
-							lcd_print_P("Ramp-up");
-							STAT_SET(PROFILE_RAMPUP);
-						}
-						break;
-					case 4:
-						if(!STAT(PROFILE_PEAK)) {
-							lcd_clrline(1);
-							lcd_set_cursor(1,9);
-							lcd_print_P("Peak");
-							STAT_SET(PROFILE_PEAK);
-						}
-						break;
-					case 5:
-						if(!STAT(PROFILE_RAMPDOWN)) {
-							lcd_clrline(1);
-							lcd_set_cursor(1,6);
-							lcd_print_P("Ramp-down");
-							STAT_SET(PROFILE_RAMPDOWN);
-						}
-						break;
-				}
-			}
-		}
+		lcd_set_cursor(1,(LCD_DISP_LENGTH-strlen_P(name))/2+1);
+		lcd_print_p(name);
 	}
 }
 
 static inline void show_profile_completion(void)
 {
 	if(STAT(PROFILE_RUNNING)) {
+		// Stop the tick accounting for the run before reading its results
+		uint8_t id = activeprofile-profiles;
+		reset_profile_state();
 		STAT_CLR(PROFILE_RUNNING);
 		lcd_clrscr();
+		safe_shown = false;	// Redraw it on the cleared screen
 		if(STAT(PROFILE_CANCEL)) {
+			batchstate = BATCH_IDLE;
 			CANCEL_TIMER_DISABLE;
 			lcd_set_cursor(2,2);
 			lcd_print_p(reflowcancelledmsg);
@@ -427,13 +707,80 @@ static inline void show_profile_completion(void)
 			lcd_set_cursor(2,3);
 			lcd_print_p(reflowcompletemsg);
 			lcd_set_cursor(3,1);
-			lcd_print_p(presstocontinuemsg);
+			if(batchstate==BATCH_RUNNING && ++batchrun<batchcount) {
+				char buf[LCD_DISP_LENGTH+1];
+				sprintf_P(buf, batchunloadmsg, batchrun, batchcount);
+				lcd_print(buf);
+				batchstate = BATCH_UNLOAD;
+			} else {
+				lcd_print_p(presstocontinuemsg);
+				batchstate = BATCH_IDLE;
+			}
+			show_run_result();
+			show_run_energy();
+			save_run_record(id);
 			start_buzzer(3,BUZZER_TIME_COMPLETE);
 		}
 	}
 	reset_profile_state();
 }
 
+static inline void show_run_result(void)
+{
+	if(setpoints.liquidus) {
+		char buf[LCD_DISP_LENGTH+1];
+		char tempsymbol[4];
+		double peak = convert_temp(setpoints.peak/(double)(1<<TEMP_FRAC_BITS), tempsymbol);
+		sprintf_P(buf, talmsg, (uint16_t)(setpoints.tal/1000), peak, tempsymbol);
+		lcd_set_cursor(4,1);
+		lcd_print(buf);
+	}
+}
+
+static inline void show_batch_state(void)
+{
+	char buf[LCD_DISP_LENGTH+1];
+	char tempsymbol[4];
+	double restart = convert_temp(BATCH_RESTART_TEMP, tempsymbol);
+	lcd_clrscr();
+	sprintf_P(buf, batchnextmsg, batchrun+1, batchcount);
+	lcd_set_cursor(1,1);
+	lcd_print(buf);
+	sprintf_P(buf, batchcoolingmsg, restart, tempsymbol);
+	lcd_set_cursor(2,1);
+	lcd_print(buf);
+	show_run_result();
+}
+
+static inline void show_run_energy(void)
+{
+	char buf[LCD_DISP_LENGTH+1];
+	sprintf_P(buf, energymsg, energy_total(&energy)/10.0,
+						energy.peak_duty/10, energy_duty(&energy, STAGE_SOAK)/10);
+	lcd_set_cursor(1,1);
+	lcd_print(buf);
+}
+
+static inline void save_run_record(uint8_t id)
+{
+	runrecord_t rec;
+	rec.profile = id;
+	rec.tal = setpoints.tal/1000;
+	rec.peak = setpoints.peak;
+	energy_record(&energy, &rec);
+	eeprom_update_block(&rec, EEPROM_RUN_ADDR, sizeof(runrecord_t));
+}
+
+static inline void show_safe_to_open(void)
+{
+	// Takes the place of the completion message once the oven has cooled
+	lcd_clrline(2);
+	lcd_set_cursor(2,(LCD_DISP_LENGTH-strlen_P(safetoopenmsg))/2+1);
+	lcd_print_p(safetoopenmsg);
+	start_buzzer(1,BUZZER_TIME_COMPLETE);
+	safe_shown = true;
+}
+
 static inline void show_about(void)
 {
 	lcd_set_cursor(1,2);
@@ -455,6 +802,82 @@ static inline void show_coming_soon(void)
 	lcd_print_p(presstocontinuemsg);
 }
 
+static inline void show_autotune_state(void)
+{
+	if(tune.state==autotune_shown) return;
+	autotune_shown = tune.state;
+	lcd_clrscr();
+	switch(tune.state) {
+		case AUTOTUNE_RUNNING:
+			lcd_set_cursor(1,6);
+			lcd_print_p(autotunemsg);
+			break;
+		case AUTOTUNE_DONE:
+			eeprom_update_block(&tune.result, EEPROM_PID_ADDR, sizeof(pidgains_t));
+			pid_init(&pid, &tune.result, RATE_CONTROL*TICK_MS);
+			lcd_set_cursor(2,2);
+			lcd_print_p(autotunecompletemsg);
+			lcd_set_cursor(3,1);
+			lcd_print_p(presstocontinuemsg);
+			start_buzzer(3,BUZZER_TIME_COMPLETE);
+			break;
+		case AUTOTUNE_FAILED:
+			lcd_set_cursor(2,3);
+			lcd_print_p(autotunefailedmsg);
+			lcd_set_cursor(3,1);
+			lcd_print_p(presstocontinuemsg);
+			start_buzzer(3,BUZZER_TIME_CANCEL);
+			break;
+	}
+}
+
+static inline void show_calibrate_state(void)
+{
+	char buf[LCD_DISP_LENGTH+1];
+	lcd_set_cursor(1,1);
+	lcd_print_p(calslot==CAL_LOW?calibratelowmsg:calibratehighmsg);
+	lcd_set_cursor(2,1);
+	lcd_print_p(calrejected?calibrateclosemsg:calibrateturnmsg);
+	sprintf_P(buf, calibrateprobemsg, tc_temp[TC_AIR]/(double)(1<<TEMP_FRAC_BITS));
+	lcd_set_cursor(3,1);
+	lcd_print(buf);
+	sprintf_P(buf, calibrateactualmsg, calref);
+	lcd_set_cursor(4,1);
+	lcd_print(buf);
+	ISRF_CLR(REPORT_TEMP);
+}
+
+static inline void show_characterize_state(void)
+{
+	if(charrun.state==characterize_shown) return;
+	characterize_shown = charrun.state;
+	switch(charrun.state) {
+		case CHAR_HEATING:
+			lcd_clrscr();
+			lcd_set_cursor(1,4);
+			lcd_print_p(characterizemsg);
+			break;
+		case CHAR_DONE:
+			model = charrun.result;
+			eeprom_update_block(&model, EEPROM_MODEL_ADDR, sizeof(ovenmodel_t));
+			lcd_clrscr();
+			lcd_set_cursor(2,1);
+			lcd_print_p(characterizecompletemsg);
+			lcd_set_cursor(3,1);
+			lcd_print_p(presstocontinuemsg);
+			start_buzzer(3,BUZZER_TIME_COMPLETE);
+			break;
+		case CHAR_FAILED:
+			lcd_clrscr();
+			lcd_set_cursor(2,1);
+			lcd_print_p(characterizefailedmsg);
+			lcd_set_cursor(3,1);
+			lcd_print_p(presstocontinuemsg);
+			start_buzzer(3,BUZZER_TIME_CANCEL);
+			break;
+	}
+}
+
 
 
 static inline void start_buzzer(uint8_t cnt, uint16_t ms) {
@@ -470,10 +893,13 @@ static inline void start_buzzer(uint8_t cnt, uint16_t ms) {
 				OCR2B = 0xFF;
 				break;
 		}
-		buzzer_time = ms/50;	// 20 timer ticks per second
-		buzzer_count = cnt*buzzer_time*2;
-		BUZZER_ENABLE;
-		TEMPREP_BUZZ_ENABLE;
+		// The tick toggles the buzzer and counts it down, and the fan shares
+		// TCCR2A
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+			buzzer_time = ms/(RATE_BUZZER*TICK_MS);	// 20 buzzer steps per second
+			buzzer_count = cnt*buzzer_time*2;
+			BUZZER_ENABLE;
+		}
 	}
 }
 
@@ -483,11 +909,9 @@ static inline void reset_profile_state(void)
 {
 	HEAT_DISABLE;
 	STAT_CLRPFSTAGE();
-	if(activeprofile) {
-		free(activeprofile);
-		activeprofile = 0x0000;
-	}
+	activeprofile = 0x0000;
 	time_ms = 0;
+	checkpoint_clear(EEPROM_CHECKPOINT_ADDR);
 }
 
 static inline void reset_cancel_timer(void)
@@ -500,38 +924,551 @@ static inline void reset_cancel_timer(void)
 static inline void reset_all(void)
 {
 	HEAT_DISABLE;
-	TEMPREP_BUZZ_DISABLE;
-	BUZZER_DISABLE;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		BUZZER_DISABLE;
+	}
+	update_fan(0);
 	ADC_ENABLE;
 	ISRF_CLRALL();
-	STAT_CLRALL();
+	STAT_CLRALLBUTCOOL();	// The fan carries on until the oven is safe to open
 	MENU_CLR();
 	menu_uninit();
 	MENU_SET(MAIN);
-	if(activeprofile) {
-		free(activeprofile);
-		activeprofile = 0x0000;
-	}
+	// A run still going here is being abandoned, by a thermocouple error or
+	// the door, so it mustn't be offered for resuming; a checkpoint left by a
+	// reset has no run behind it yet and is kept
+	if(activeprofile) checkpoint_clear(EEPROM_CHECKPOINT_ADDR);
+	activeprofile = 0x0000;
 	ctovf_count = 0;
 	time_ms = 0;
+	targettemp = 0;
+	batchstate = BATCH_IDLE;
+	safe_shown = flaky_shown = false;
+	power_reset();
+	lastdemand = 0;
+	tune.state = autotune_shown = AUTOTUNE_IDLE;
+	charrun.state = characterize_shown = CHAR_IDLE;
+	ffdemand = 0;
 }
 
 
 
-ISR(ADC_vect)
+static inline uint8_t record_reset_cause(void)
+{
+	uint8_t cause = RESET_POWERON;
+	if(mcusr_mirror&(1<<WDRF))				cause = RESET_WATCHDOG;
+	else if(mcusr_mirror&(1<<BORF))		cause = RESET_BROWNOUT;
+	else if(mcusr_mirror&(1<<EXTRF))	cause = RESET_EXTERNAL;
+	eeprom_update_byte(EEPROM_RESET_ADDR, cause);
+	if(cause==RESET_WATCHDOG) {
+		uint8_t count = eeprom_read_byte(EEPROM_WDTCOUNT_ADDR);
+		if(count==0xFF) count = 0;	// Never written
+		if(count<0xFE) eeprom_update_byte(EEPROM_WDTCOUNT_ADDR, count+1);
+	}
+	return cause;
+}
+
+static inline bool start_profile(uint8_t id, const checkpoint_t *cp)
+{
+	if(id>=sizeof(profiles)/sizeof(profdef_t)) return false;
+	
+	// Coming out of standby the controller and estimator are already settled
+	// on the oven, so carry them over rather than starting from scratch
+	bool warm = STAT(STANDBY);
+	STAT_CLR(STANDBY);
+	STAT_CLRCOOL();	// The last run's cooling is over once this one heats
+	cli();
+	int16_t measured = temperature_fx;
+	sei();
+	if(!warm) {
+		pid_reset(&pid, measured);
+		est_reset(&est, measured);
+	}
+	
+	profile_load(&setpoints, &profiles[id]);
+	if(model_valid(&model) && model.tau)
+		profile_load_reference(&setpoints, ((uint32_t)model.gain<<TEMP_FRAC_BITS)/model.tau);
+	if(cp) {
+		// Carry on from the checkpoint, winding back to where the oven now is
+		profile_restore(&setpoints, cp->index, cp->elapsed*100UL, cp->tal*100UL,
+										cp->peak, cp->load_scale);
+		profile_resume(&setpoints, est.temp);
+	} else {
+		profile_warm_start(&setpoints, est.temp);
+	}
+	energy_reset(&energy);
+	protect_reset(&prot);
+	checkpoint_index = 0xFF;	// Checkpoint straight away
+	
+	// Only hand the profile to the tick once everything is ready for it
+	activeprofile = &profiles[id];
+	ADC_ENABLE;
+	STAT_SET(PROFILE_RUNNING);
+	return true;
+}
+
+// Whether an interrupted run can be safely picked up again
+static inline bool offer_resume(void)
+{
+	if(resumecp.profile>=sizeof(profiles)/sizeof(profdef_t)) return false;
+	profdef_t d;
+	memcpy_P(&d, &profiles[resumecp.profile], sizeof(profdef_t));
+	if(resumecp.index>=d.count) return false;
+	if(pgm_read_byte(&d.segs[resumecp.index].stage)==STAGE_RAMPDOWN) return false;
+	
+	// Let the averaging pool fill before judging how much heat was lost
+	_delay_ms(FILTER_WINDOW*FILTER_SAMPLE_MS*2);
+	cli();
+	int16_t t = temperature_fx;
+	sei();
+	return t+TEMP_FX(CHECKPOINT_MAX_DROP)>=resumecp.temp;
+}
+
+static inline void update_checkpoint(void)
+{
+	// Snapshot the engine with the tick held off so it's self-consistent
+	cli();
+	uint32_t now = time_ms;
+	uint8_t index = setpoints.index;
+	uint32_t elapsed = setpoints.elapsed;
+	uint32_t tal = setpoints.tal;
+	int16_t peak = setpoints.peak;
+	uint16_t scale = setpoints.load_scale;
+	int16_t temp = est.temp;
+	uint8_t stage = profile_stage(&setpoints);
+	sei();
+	
+	// Write on every new segment and every CHECKPOINT_SECS within one; there's
+	// nothing to resume once the ramp-down has begun
+	if(stage==STAGE_RAMPDOWN) return;
+	if(index==checkpoint_index && now-checkpoint_ms<CHECKPOINT_SECS*1000UL) return;
+	checkpoint_t cp;
+	cp.profile = activeprofile-profiles;
+	cp.index = index;
+	cp.elapsed = (elapsed>6553500UL)?0xFFFF:elapsed/100;
+	cp.tal = (tal>6553500UL)?0xFFFF:tal/100;
+	cp.peak = peak;
+	cp.temp = temp;
+	cp.load_scale = scale;
+	cp.batchrun = (batchstate==BATCH_RUNNING)?batchrun:0;
+	cp.batchcount = (batchstate==BATCH_RUNNING)?batchcount:0;
+	checkpoint_save(EEPROM_CHECKPOINT_ADDR, &cp);
+	checkpoint_index = index;
+	checkpoint_ms = now;
+}
+
+static inline void load_pid_gains(void)
+{
+	pidgains_t gains;
+	eeprom_read_block(&gains, EEPROM_PID_ADDR, sizeof(pidgains_t));
+	if(gains.kp==0xFFFF) {
+		gains.kp = PID_DEFAULT_KP;
+		gains.ti = PID_DEFAULT_TI;
+		gains.td = PID_DEFAULT_TD;
+	}
+	pid_init(&pid, &gains, RATE_CONTROL*TICK_MS);
+}
+
+static inline void load_oven_model(void)
+{
+	eeprom_read_block(&model, EEPROM_MODEL_ADDR, sizeof(ovenmodel_t));
+}
+
+static inline void load_filter(void)
+{
+	uint8_t config = eeprom_read_byte(EEPROM_FILTER_ADDR);
+	if(config==0xFF) config = FILTER_DEFAULT;
+	for(uint8_t i=0; i<TC_CHANNELS; i++)
+		filter_init(&tcfilter[i], config);
+	est_set_delay(&est, filter_delay_ms(config));
+}
+
+// Which thermocouples control works from; every channel is scanned and
+// filtered regardless, so switching doesn't wait for a filter to fill
+static inline void load_probe_mix(void)
+{
+	uint8_t sel = eeprom_read_byte(EEPROM_PROBE_ADDR);
+	if(sel>=sizeof(tc_mixes)/sizeof(tc_mixes[0])) sel = 0;
+	for(uint8_t i=0; i<TC_CHANNELS; i++)
+		tc_mix[i] = pgm_read_byte(&tc_mixes[sel][i]);
+}
+
+static inline void start_autotune(void)
+{
+	stop_standby();
+	STAT_CLRCOOL();
+	protect_reset(&prot);
+	autotune_start(&tune, TEMP_FX(AUTOTUNE_SETPOINT), RATE_CONTROL*TICK_MS);
+	est_reset(&est, temperature_fx);
+	targettemp = TEMP_FX(AUTOTUNE_SETPOINT);
+	ADC_ENABLE;
+	STAT_SET(AUTOTUNE);
+}
+
+static inline void start_characterize(void)
+{
+	stop_standby();
+	STAT_CLRCOOL();	// The fan would spoil the cooling measurement
+	protect_reset(&prot);
+	cli();
+	int16_t ambient = temperature_fx;
+	sei();
+	model_char_start(&charrun, ambient, RATE_CONTROL*TICK_MS);
+	est_reset(&est, ambient);
+	targettemp = TEMP_FX(CHAR_TARGET);
+	ADC_ENABLE;
+	STAT_SET(CHARACTERIZE);
+}
+
+// Two-point calibration: the probe sits at a known temperature (a reference
+// thermometer alongside, or boiling water for the high point) and the
+// actual value is dialled in, starting from what the probe reads now
+static inline void start_calibrate(uint8_t slot)
+{
+	calslot = slot;
+	calref = temperature;
+	calrejected = false;
+	ADC_ENABLE;
+	MENU_CLR();
+	STAT_SET(CALIBRATE);
+	ISRF_SET(REPORT_TEMP);
+}
+
+static inline void finish_calibrate(void)
+{
+	cli();
+	uint16_t reading = supply_correct(&supply, tc_q4[TC_AIR]);
+	sei();
+	if(cal_capture(EEPROM_CAL_ADDR, calslot, reading, TEMP_FX(calref))) {
+		STAT_CLR(CALIBRATE);
+		MENU_SET(CALIBRATE);
+	} else {
+		calrejected = true;
+		ISRF_SET(REPORT_TEMP);
+	}
+}
+
+static inline void start_standby(void)
+{
+	int16_t target = TEMP_FX(STANDBY_TEMP(EEPROM(STANDBY)));
+	cli();
+	int16_t measured = temperature_fx;
+	sei();
+	pid_reset(&pid, measured);
+	est_reset(&est, measured);
+	protect_reset(&prot);
+	uint16_t ff = model_valid(&model)?model_feedforward(&model, target, 0):0;
+	cli();
+	targettemp = target;
+	ffdemand = ff;
+	sei();
+	ADC_ENABLE;
+	STAT_SET(STANDBY);
+}
+
+static inline void stop_standby(void)
+{
+	if(!STAT(STANDBY)) return;
+	STAT_CLR(STANDBY);
+	power_reset();
+	cli();
+	targettemp = 0;
+	ffdemand = 0;
+	sei();
+}
+
+
+
+static inline void start_batch_cooling(void)
+{
+	MENU_CLR();
+	menu_uninit();
+	batchstate = BATCH_COOLING;
+	// The next run waits for BATCH_RESTART_TEMP, below where the fan would
+	// otherwise have stopped, so it's run on down to that
+	cli();
+	int16_t t = est.temp;
+	sei();
+	if(t>=TEMP_FX(BATCH_RESTART_TEMP) && !STAT(COOLING)) {
+		cool_reset(&cool, t);
+		STAT_CLR(SAFE_OPEN);
+		STAT_SET(COOLING);
+	}
+	show_batch_state();
+}
+
+static inline void update_batch(void)
+{
+	// Start the next run once the oven is cool enough to load again
+	cli();
+	uint16_t t = temperature;
+	sei();
+	if(t<BATCH_RESTART_TEMP && start_profile(batchprofile, 0)) {
+		lcd_clrscr();
+		batchstate = BATCH_RUNNING;
+	}
+}
+
+
+
+static inline bool pause_profile(void)
+{
+	// The tick has already cut the heater and stopped the profile clock, so
+	// the run just waits here for the door to close again
+	cli();
+	pause_ms = 0;
+	sei();
+	lcd_clrscr();
+	lcd_set_cursor(2,6);
+	lcd_print_p(runpausedmsg);
+	uint8_t shown = 0;
+	while(STAT(DOOR_OPEN) && !STAT(TC_ERROR)) {
+		WDT_CHECKIN(MAIN);
+		cli();
+		uint16_t ms = pause_ms;
+		sei();
+		if(ms>=DOOR_PAUSE_MAX*1000U) break;
+		uint8_t left = DOOR_PAUSE_MAX-ms/1000;
+		if(left!=shown) show_run_paused(shown = left);
+	}
+	if(STAT(DOOR_OPEN) || STAT(TC_ERROR)) {
+		reset_profile_state();	// Too long, or unsafe: the run is abandoned
+		return false;
+	}
+	
+	// Door closed in time: pick the run up where it stopped
+	cli();
+	int16_t measured = temperature_fx;
+	sei();
+	est_reset(&est, measured);
+	pid_resume(&pid, measured);
+	protect_reset(&prot);
+#if DOOR_RESUME_CATCHUP
+	profile_resume(&setpoints, measured);
+#endif
+	lcd_clrscr();
+	STAT_CLRPFSTAGE();	// Redraw the stage name
+	return true;
+}
+
+
+
+static inline void run_deferred_tasks(void)
+{
+	// Run with interrupts enabled so the tick, ADC and inputs can pre-empt us;
+	// pending flags are claimed atomically since the tick may set more at any time
+	uint8_t pending;
+	TASK_SET(RUNNING);
+	do {
+		pending = TASK_PENDING();
+		TASK_CLRPENDING();
+		sei();
+		if(pending&(1<<TASK_POWER))			power_step();
+		if(pending&(1<<TASK_SETPOINT))	update_setpoint();
+		if(pending&(1<<TASK_CONTROL))		update_control();
+		cli();
+	} while(pending);
+	TASK_CLR(RUNNING);
+}
+
+static inline void update_setpoint(void)
+{
+	if(!activeprofile) return;
+	
+	// Stage conditions are judged on the estimated true temperature
+	int16_t target = profile_step(&setpoints, RATE_SETPOINT*TICK_MS, est.temp, lastdemand);
+	if(setpoints.done) {
+		STAT_SET(PROFILE_COMPLETE);
+		targettemp = 0;
+		ffdemand = 0;
+		return;
+	}
+	targettemp = target;
+	
+	// Hand the ramp-down over to the cooling loop, which carries on after the end
+	if(profile_stage(&setpoints)==STAGE_RAMPDOWN && !STAT(COOLING) && !STAT(SAFE_OPEN)) {
+		cool_reset(&cool, est.temp);
+		STAT_SET(COOLING);
+	}
+	
+	// Feed forward what the oven model needs to be on the setpoint one dead
+	// time from now, so power goes in before the setpoint actually changes
+	uint16_t ff = 0;
+	if(model_valid(&model)) {
+		int16_t ahead = profile_peek(&setpoints, model.deadtime*1000UL);
+		int16_t slope = profile_peek(&setpoints, model.deadtime*1000UL+1000)-ahead;
+		ff = model_feedforward(&model, ahead, slope);
+	}
+	cli();
+	ffdemand = ff;
+	sei();
+}
+
+// Only drive the heater while something is controlling it, and never with
+// the door open, without a working thermocouple or after a heater fault
+static inline bool heater_enabled(void)
 {
-	adc_average[(average_count++)%NUM_AVERAGE] = round(ADC*(1000.0/0xFF));
+	return (activeprofile || STAT_TUNING() || STAT(STANDBY) || STAT(COOLING)) &&
+				 !STAT(DOOR_OPEN) && !STAT(TC_ERROR) && !STAT(FAULT);
+}
+
+static inline void update_control(void)
+{
+	cli();
+	int16_t measured = temperature_fx;
+	int16_t setpoint = targettemp;
+	uint16_t ff = ffdemand;
+	sei();
+	
+	// With the heater held off, only check it isn't heating on its own;
+	// there's nothing to check against without a working thermocouple
+	if(!heater_enabled()) {
+		if(STAT(TC_ERROR))	protect_reset(&prot);
+		else if(!STAT(FAULT) && protect_update(&prot, measured, 0, model_valid(&model)?&model:0))
+			STAT_SET(FAULT);
+		lastdemand = 0;
+		return;
+	}
 	
-	// Calculate the average from our pool of readings
-	uint16_t average = 0;
-	for(uint8_t i=0; i<NUM_AVERAGE; i++)
-		average += adc_average[i];
-	temperature = round(average/NUM_AVERAGE);
+	// Estimate the true temperature from the lagging thermocouple reading;
+	// the tuning runs characterize the raw reading so they use it directly
+	est_update(&est, measured, lastdemand, model_valid(&model)?&model:0);
 	
-	if(temperature<=5 || temperature>=995)
+	uint16_t demand = 0;
+	if(STAT(AUTOTUNE))					demand = autotune_update(&tune, measured);
+	else if(STAT(CHARACTERIZE))	demand = model_char_update(&charrun, measured);
+	else if(activeprofile ||
+					STAT(STANDBY))					demand = pid_update(&pid, setpoint, est.temp, ff);
+	// Check the heater is doing what it's told, and stop it for good if not
+	if(protect_update(&prot, measured, demand, model_valid(&model)?&model:0)) {
+		STAT_SET(FAULT);
+		demand = 0;
+	}
+	lastdemand = demand;
+	
+	if(activeprofile) energy_demand(&energy, demand);
+	
+	// Spread the demand over the heater channels as the profile stage asks
+	for(uint8_t ch=0; ch<POWER_CHANNELS; ch++) {
+		uint8_t share = activeprofile?profile_split(&setpoints, ch):0xFF;
+		power_set(ch, ((uint32_t)demand*share)/0xFF);
+	}
+	
+	// Run the fan against the ramp-down until the oven is safe to open, or
+	// in a batch until it's cool enough to load the next one
+	uint8_t fan = 0;
+	if(STAT(COOLING)) {
+		int16_t done = (batchstate==BATCH_COOLING)?TEMP_FX(BATCH_RESTART_TEMP):TEMP_FX(COOLING_SAFE_TEMP);
+		if(est.temp<done) {
+			STAT_CLR(COOLING);
+			STAT_SET(SAFE_OPEN);
+		} else if(!demand) {
+			fan = cool_update(&cool, (activeprofile && !setpoints.done)?setpoint:COOL_NO_SETPOINT,
+												est.temp, est.tempslope);
+		}
+	}
+	update_fan(fan);
+}
+
+static inline void update_fan(uint8_t duty)
+{
+#if COOLING_FAN
+	// The buzzer shares TCCR2A and is toggled from the tick
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		FAN_DUTY(duty);
+		if(duty)	FAN_ENABLE;
+		else			FAN_DISABLE;
+	}
+#endif
+}
+
+
+
+// Classify, filter, supply-correct and calibrate one thermocouple sample.
+// A sample taken while a heater was switching skips the classification.
+static inline void sample_thermocouple(uint8_t ch, uint16_t reading, bool blanked)
+{
+	uint8_t fault = 0;
+	if(!blanked) fault = tcf_sample(&tcf[ch], reading);
+	tc_faults[ch] = fault;
+	tc_q4[ch] = filter_sample(&tcfilter[ch], reading, !blanked && !(fault&TCF_GLITCH));
+	tc_temp[ch] = cal_lookup(supply_correct(&supply, tc_q4[ch]));
+}
+
+// Mix the channels into the temperature control works from. Only channels
+// that are part of the mix can raise a thermocouple error or warning.
+static inline void update_temperature(void)
+{
+	int32_t mix = 0;
+	bool error = false, flaky = false, clean = true;
+	for(uint8_t i=0; i<TC_CHANNELS; i++) {
+		if(!tc_mix[i]) continue;
+		int16_t t = (tc_temp[i]+(1<<(TEMP_FRAC_BITS-1)))>>TEMP_FRAC_BITS;
+		if(t<=5 || t>=995 || (tc_faults[i]&TCF_FAULT))	error = true;
+		if(tc_faults[i]&TCF_FLAKY)											flaky = true;
+		if(tcf[i].score)																clean = false;
+		mix += (int32_t)tc_mix[i]*tc_temp[i];
+	}
+	temperature_fx = mix>>TC_MIX_BITS;
+	temperature = (temperature_fx+(1<<(TEMP_FRAC_BITS-1)))>>TEMP_FRAC_BITS;
+	
+	if(error)
 		STAT_SET(TC_ERROR);
 	else
 		STAT_CLR(TC_ERROR);
+	if(flaky)
+		STAT_SET(TC_FLAKY);
+	else if(clean)
+		STAT_CLR(TC_FLAKY);
+}
+
+// Scan sequencer. The tick starts the first conversion of a scan and each
+// conversion here chains on to the next entry: the thermocouple channels in
+// turn, then the bandgap every SUPPLY_INTERVAL scans. The whole scan takes
+// well under a sample period, so every channel keeps the 2ms sample rate
+// its filter is sized for. The first conversion after the mux moves is
+// thrown away while the sample and hold catches up with the new input.
+ISR(ADC_vect)
+{
+	static uint8_t entry = 0;
+	static bool settling = false;
+	static bool bandgap_due = false;
+	static uint8_t supply_div = SUPPLY_INTERVAL;
+	uint16_t reading = ADC;
+	
+	if(settling) {
+		settling = false;
+		ADC_START;
+		return;
+	}
+	
+	if(entry<TC_CHANNELS) {
+		// The supply is disturbed while a heater switches too, so the bandgap
+		// waits for a clean scan
+		if(!entry && !adc_blanked && !--supply_div) {
+			supply_div = SUPPLY_INTERVAL;
+			bandgap_due = true;
+		}
+		sample_thermocouple(entry, reading, adc_blanked);
+	} else {
+		supply_sample(&supply, reading);
+		bandgap_due = false;
+	}
+	
+	// Move on, or back to the start of the list to wait for the tick
+	uint8_t next = entry+1;
+	if(next==TC_CHANNELS && !bandgap_due) next++;
+	if(next>TC_CHANNELS) {
+		update_temperature();
+		next = 0;
+	}
+	uint8_t mux = (next<TC_CHANNELS)?pgm_read_byte(&tc_mux[next]):ADC_MUX_BANDGAP;
+	if((ADMUX&0x0F)!=mux) {
+		ADC_SELECT(mux);
+		settling = true;
+	}
+	entry = next;
+	if(entry) ADC_START;
 }
 
 ISR(TIMER0_COMPA_vect)
@@ -549,53 +1486,130 @@ ISR(TIMER0_OVF_vect)
 
 ISR(TIMER1_COMPA_vect)
 {
-	if(activeprofile) {
-		targettemp = 0;
-		double time_sec = time_ms/1000.0;
-		if(time_sec <= *activeprofile) {
-			targettemp = *(activeprofile+1);
-		} else if(time_sec >= *(activeprofile+(PROFILE_LENGTH-1)*PROFILE_DATLEN)) {
-			STAT_SET(PROFILE_COMPLETE);
-		} else {
-			uint8_t i = PROFILE_LENGTH;
-			while(--i) {
-				if(time_sec <= *(activeprofile+(i*PROFILE_DATLEN)) &&
-					 time_sec > *(activeprofile+((i-1)*PROFILE_DATLEN))) {
-					uint16_t x0 = *(activeprofile+((i-1)*PROFILE_DATLEN));
-					uint16_t x1 = *(activeprofile+(i*PROFILE_DATLEN));
-					int16_t y0 = *(activeprofile+((i-1)*PROFILE_DATLEN)+1)*10;
-					int16_t y1 = *(activeprofile+(i*PROFILE_DATLEN)+1)*10;
-					targettemp = (y0+((y1-y0)*((time_sec-x0)/(x1-x0))))/10;
-				}
-			}
+	static uint8_t sample_div = RATE_SAMPLE;
+	static uint8_t control_div = RATE_CONTROL;
+	static uint8_t setpoint_div = RATE_SETPOINT;
+	static uint16_t display_div = RATE_DISPLAY;
+	static uint8_t buzzer_div = RATE_BUZZER;
+	static uint8_t blank_ticks = 0;
+	static uint8_t heat_prev = 0;
+	uint8_t heat = 0;
+	
+	// Pet the watchdog only once the main loop has also shown signs of life.
+	// Interrupts are still off here, so INT0 can't touch GPIOR0 in between.
+	WDT_CHECKIN(TICK);
+	if((GPIOR0&WDT_ALL)==WDT_ALL) {
+		wdt_reset();
+		GPIOR0 &= ~WDT_ALL;
+	}
+	
+	// Pick up the door state posted by INT0 before anything drives the heater
+	if(DOOR_OPENED) {
+		if(!STAT(DOOR_OPEN))	STAT_SET(DOOR_OPEN);
+	} else if(STAT(DOOR_OPEN)) {
+		STAT_CLR(DOOR_OPEN);
+	}
+	
+	// Start the next thermocouple conversion
+	if(!--sample_div) {
+		sample_div = RATE_SAMPLE;
+		if(ADC_ENABLED) {
+			adc_blanked = (blank_ticks!=0);
+			ADC_START;
 		}
+	}
+	
+	if(heater_enabled()) {
+		heat = power_update();
+		HEAT_SET(heat);
+		TASK_SET(POWER);	// The per-channel work runs with interrupts enabled
+		if(activeprofile) energy_tick(&energy, profile_stage(&setpoints), heat, TICK_MS);
 		
-		if(temperature<targettemp)	HEAT_ENABLE;
-		else												HEAT_DISABLE;
-		
-		time_ms += 50;	// Add 0.05 seconds to the global timer
-		// Report the temperature every 500ms
-		if((!(time_ms%500)) && STAT_SET(PROFILE_RUNNING))
+		time_ms += TICK_MS;	// Add one tick to the global timer
+		if(!--setpoint_div) {
+			setpoint_div = RATE_SETPOINT;
+			TASK_SET(SETPOINT);
+		}
+	} else {
+		HEAT_DISABLE;	// Nothing is controlling the heater, so keep it off
+		update_fan(0);
+		if(STAT(DOOR_OPEN) && pause_ms<UINT16_MAX) pause_ms += TICK_MS;
+	}
+	
+	// Control runs even while idle, so the heater protection keeps watching
+	if(!--control_div) {
+		control_div = RATE_CONTROL;
+		TASK_SET(CONTROL);
+	}
+	
+	// Samples taken just after a heater switches carry its transient
+	if(heat!=heat_prev) {
+		heat_prev = heat;
+		blank_ticks = ADC_BLANK_MS/TICK_MS;
+	} else if(blank_ticks) {
+		blank_ticks--;
+	}
+	
+	// Report the temperature at the display rate
+	if(!--display_div) {
+		display_div = RATE_DISPLAY;
+		if(STAT(PROFILE_RUNNING) || tune.state==AUTOTUNE_RUNNING ||
+			 charrun.state==CHAR_HEATING || charrun.state==CHAR_COOLING ||
+			 batchstate==BATCH_COOLING || STAT(CALIBRATE))
 			ISRF_SET(REPORT_TEMP);
 	}
-	if(buzzer_count) {
-		buzzer_count--;
-		if(buzzer_count && !(buzzer_count%buzzer_time)) BUZZER_TOGGLE;
+	
+	if(!--buzzer_div) {
+		buzzer_div = RATE_BUZZER;
+		if(buzzer_count) {
+			buzzer_count--;
+			if(buzzer_count && !(buzzer_count%buzzer_time)) BUZZER_TOGGLE;
+		}
 	}
+	
+	// Hand the heavier work to the deferred tasks, unless we interrupted them
+	if(TASK_PENDING() && !TASK(RUNNING)) run_deferred_tasks();
+}
+
+#if POWER_ZC == POWER_ZC_INPUT
+ISR(PCINT0_vect)
+{
+	// The detector pulses high at each mains zero crossing
+	if(PINB&(1<<0)) power_zero_cross();
+}
+#endif
+
+// Door switch. Written out in single-bit I/O instructions (sbis, cbi, sbi)
+// that touch no registers or flags, so the handler needs no prologue: the
+// heater pins go low within a dozen cycles of the interrupt being taken. It's
+// in assembly because a naked handler can't rely on the compiler to pick
+// those instructions for C. The tick picks the event up from GPIOR0 on its
+// next pass.
+ISR(INT0_vect, ISR_NAKED)
+{
+	asm volatile(
+		"sbis %[pind], 2"						"\n\t"	// Door switch high (door is open)?
+		"rjmp 1f"										"\n\t"
+		"cbi %[portd], 4"						"\n\t"	// Heater channel 0 off
+#if POWER_CHANNELS > 1
+		"cbi %[portb], 1"						"\n\t"	// Heater channel 1 off
+#endif
+		"sbi %[gpior], %[event]"		"\n\t"
+		"reti"											"\n"
+		"1:	cbi %[gpior], %[event]"	"\n\t"	// Door switch low (door is closed)
+		"reti"
+		:: [pind] "I" (_SFR_IO_ADDR(PIND)),
+			 [portd] "I" (_SFR_IO_ADDR(PORTD)),
+			 [portb] "I" (_SFR_IO_ADDR(PORTB)),
+			 [gpior] "I" (_SFR_IO_ADDR(GPIOR0)),
+			 [event] "I" (DOOR_EVENT)
+	);
 }
 
 ISR(PCINT2_vect)
 {
 	volatile static uint8_t pd_prev = 0xFF;
 	
-	// Check if door switch is high (door is open)
-	if(PIND&(1<<2)) {
-		STAT_SET(DOOR_OPEN);
-	// Check if door switch is low (door is closed)
-	} else {
-		STAT_CLR(DOOR_OPEN);
-	}
-	
 	// Check encoder A and B values
 	static const int8_t _encoder_lookup[] PROGMEM = { 0,-1, 1, 0,
 																									  1, 0, 0,-1,
@@ -9,18 +9,53 @@
 #include <avr/interrupt.h>
 #include <avr/pgmspace.h>
 #include <avr/eeprom.h>
+#include <avr/wdt.h>
+#include <util/atomic.h>
 #include <util/delay.h>
 
 #include "globals.h"
 #include "lcd_menu.h"
+#include "pid.h"
+#include "power.h"
+#include "model.h"
+#include "estimator.h"
+#include "profile.h"
+#include "cooling.h"
+#include "energy.h"
+#include "protect.h"
+#include "tcfault.h"
+#include "checkpoint.h"
+#include "calibrate.h"
+#include "supply.h"
+#include "filter.h"
 
 #define PROGRAM_NAME	"Solder Reflow"
 #define PROGRAM_VER		"1.0"
 #define PROGRAM_DEV		"BattyBovine"
 
 /* Interrupt macros */
-#define HEAT_ENABLE						(PORTD |= (1<<4))
+// Heater channel 0 (top) is on PD4, channel 1 (bottom) on PB1; the INT0
+// handler clears the same pins in assembly
+#if POWER_CHANNELS > 1
+#define HEAT_DISABLE					(PORTD &= ~(1<<4), PORTB &= ~(1<<1))
+#define HEAT_SET(m)						{if((m)&(1<<0)) PORTD |= (1<<4); else PORTD &= ~(1<<4);\
+															 if((m)&(1<<1)) PORTB |= (1<<1); else PORTB &= ~(1<<1);}
+#else
 #define HEAT_DISABLE					(PORTD &= ~(1<<4))
+#define HEAT_SET(m)						{if((m)&(1<<0)) PORTD |= (1<<4); else PORTD &= ~(1<<4);}
+#endif
+
+// Door switch on INT0 (PD2), posted to the tick through a GPIOR0 bit
+#define DOOR_ENABLE						(EIMSK |= (1<<INT0))
+#define DOOR_EVENT						0
+#define DOOR_OPENED						(GPIOR0&(1<<DOOR_EVENT))
+
+// Watchdog check-ins, also in GPIOR0 so each is a single sbi
+#define WDT_TIMEOUT						WDTO_500MS
+#define WDT_TICK							1
+#define WDT_MAIN							2
+#define WDT_CHECKIN(f)				(GPIOR0 |= (1<<WDT_##f))
+#define WDT_ALL								((1<<WDT_TICK)|(1<<WDT_MAIN))
 
 #define INPUT_ENABLE					(PCICR |= (1<<PCIE2))
 #define INPUT_DISABLE					(PCICR &= ~(1<<PCIE2))
@@ -28,13 +63,21 @@
 #define BUZZER_ENABLE					(TCCR2A |= (1<<COM2B1))
 #define BUZZER_DISABLE				(TCCR2A &= ~(1<<COM2B1))
 #define BUZZER_TOGGLE					(TCCR2A ^= (1<<COM2B1))
-#define BUZZER_ENABLED				(TCCR2A &= (1<<COM2B1))
+#define BUZZER_ENABLED				(TCCR2A & (1<<COM2B1))
+
+#define FAN_ENABLE						(TCCR2A |= (1<<COM2A1))
+#define FAN_DISABLE						(TCCR2A &= ~(1<<COM2A1))
+#define FAN_DUTY(d)						(OCR2A = (d))
 
-#define ADC_ENABLE						(ADCSRA |= ((1<<ADSC)|(1<<ADIE)))
-#define ADC_DISABLE						(ADCSRA &= ~((1<<ADSC)|(1<<ADIE)))
+#define ADC_ENABLE						(ADCSRA |= (1<<ADIE))
+#define ADC_DISABLE						(ADCSRA &= ~(1<<ADIE))
+#define ADC_ENABLED						(ADCSRA&(1<<ADIE))
+#define ADC_START							(ADCSRA |= (1<<ADSC))
+#define ADC_SELECT(m)					(ADMUX = (ADMUX&0xF0)|(m))
+#define ADC_MUX_BANDGAP				0x0E		// Internal 1.1V reference
 
-#define TEMPREP_BUZZ_ENABLE		(TIMSK1 |= (1<<OCIE1A))
-#define TEMPREP_BUZZ_DISABLE	(TIMSK1 &= ~(1<<OCIE1A))
+#define TICK_ENABLE						(TIMSK1 |= (1<<OCIE1A))
+#define TICK_DISABLE					(TIMSK1 &= ~(1<<OCIE1A))
 
 #define DEBOUNCE_ENABLE				(TIMSK0 |= (1<<OCIE0A))
 #define DEBOUNCE_DISABLE			(TIMSK0 &= ~(1<<OCIE0A))
@@ -46,6 +89,35 @@
 
 
 
+/* Scheduler rates, in system ticks */
+#define TICK_MS								1				// 1ms system tick from timer 1
+#define RATE_SAMPLE						2				// Thermocouple conversion every 2ms
+#define RATE_CONTROL					10			// Control law every 10ms
+#define RATE_SETPOINT					50			// Setpoint generation every 50ms
+#define RATE_DISPLAY					250			// Temperature report every 250ms (4Hz)
+#define RATE_BUZZER						50			// Buzzer timing in 50ms steps
+
+#if RATE_CONTROL*TICK_MS > 10
+	#error "Control period must be 10ms or less"
+#endif
+#if RATE_DISPLAY*TICK_MS < 200 || RATE_DISPLAY*TICK_MS > 500
+	#error "Display refresh must be between 2Hz and 5Hz"
+#endif
+
+/* Deferred task flags */
+volatile uint8_t taskflags = 0x00;
+#define TASK(f)								(taskflags&(1<<TASK_##f))
+#define TASK_SET(f)						(taskflags|=(1<<TASK_##f))
+#define TASK_CLR(f)						(taskflags&=~(1<<TASK_##f))
+#define TASK_PENDING()				(taskflags&((1<<TASK_SETPOINT)|(1<<TASK_CONTROL)|(1<<TASK_POWER)))
+#define TASK_CLRPENDING()			(taskflags&=~((1<<TASK_SETPOINT)|(1<<TASK_CONTROL)|(1<<TASK_POWER)))
+#define TASK_SETPOINT					0
+#define TASK_CONTROL					1
+#define TASK_POWER						2
+#define TASK_RUNNING					7
+
+
+
 /* Interrupt flags */
 volatile uint8_t isrflags = 0x00;
 #define ISRF(f)								(isrflags&(1<<ISRF_##f))
@@ -65,37 +137,53 @@ volatile uint8_t isrflags = 0x00;
 #define	ISRF_NEXT							6
 #define	ISRF_CANCEL						7
 
-/* Program status flags */
-volatile uint16_t statusflags = 0x0000;
-#define STAT(f)								(statusflags&(1<<STAT_##f))
+/* Program status flags. The main loop, the deferred tasks and the tick all
+ * change them, and a change is four byte-wide read-modify-writes, so each
+ * one is made with interrupts off. */
+volatile uint32_t statusflags = 0x00000000;
+#define STAT_MODIFY(x)				do { ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { x; } } while(0)
+#define STAT(f)								(statusflags&(1UL<<STAT_##f))
 #define STAT_ANY()						(statusflags)
 #define STAT_PFSTAGE()				(statusflags&(\
-																(1<<STAT_PROFILE_PREHEAT)|\
-																(1<<STAT_PROFILE_SOAK)|\
-																(1<<STAT_PROFILE_RAMPUP)|\
-																(1<<STAT_PROFILE_PEAK)|\
-																(1<<STAT_PROFILE_RAMPDOWN)))
+																(1UL<<STAT_PROFILE_PREHEAT)|\
+																(1UL<<STAT_PROFILE_SOAK)|\
+																(1UL<<STAT_PROFILE_RAMPUP)|\
+																(1UL<<STAT_PROFILE_PEAK)|\
+																(1UL<<STAT_PROFILE_RAMPDOWN)))
 #define STAT_PFEND()					(statusflags&(\
-																(1<<STAT_PROFILE_COMPLETE)|\
-																(1<<STAT_PROFILE_CANCEL)|\
-																(1<<STAT_PROFILE_NO_TC)))
-#define STAT_SET(f)						(statusflags|=(1<<STAT_##f))
-#define STAT_MENU()						(statusflags&((1<<STAT_MAIN_MENU)|\
-															(1<<STAT_SETTINGS_MENU)|(1<<STAT_UNITS_MENU)))
-#define STAT_CLR(f)						(statusflags&=~(1<<STAT_##f))
-#define STAT_CLRPFSTAGE()			(statusflags&=~(\
-																(1<<STAT_PROFILE_PREHEAT)|\
-																(1<<STAT_PROFILE_SOAK)|\
-																(1<<STAT_PROFILE_RAMPUP)|\
-																(1<<STAT_PROFILE_PEAK)|\
-																(1<<STAT_PROFILE_RAMPDOWN)))
-#define STAT_CLRPFEND()				(statusflags&=~(\
-																(1<<STAT_PROFILE_COMPLETE)|\
-																(1<<STAT_PROFILE_CANCEL)|\
-																(1<<STAT_PROFILE_NO_TC)))
-#define STAT_CLRMENU()				(statusflags&=~((1<<STAT_MAIN_MENU)|\
-															(1<<STAT_SETTINGS_MENU)|(1<<STAT_UNITS_MENU)))
-#define STAT_CLRALL()					(statusflags=0x0000)
+																(1UL<<STAT_PROFILE_COMPLETE)|\
+																(1UL<<STAT_PROFILE_CANCEL)|\
+																(1UL<<STAT_PROFILE_NO_TC)))
+#define STAT_TUNING()					(statusflags&((1UL<<STAT_AUTOTUNE)|\
+															(1UL<<STAT_CHARACTERIZE)))
+#define STAT_SET(f)						STAT_MODIFY(statusflags|=(1UL<<STAT_##f))
+#define STAT_MENU()						(statusflags&((1UL<<STAT_MAIN_MENU)|\
+															(1UL<<STAT_SETTINGS_MENU)|(1UL<<STAT_UNITS_MENU)))
+#define STAT_CLR(f)						STAT_MODIFY(statusflags&=~(1UL<<STAT_##f))
+#define STAT_CLRPFSTAGE()			STAT_MODIFY(statusflags&=~(\
+																(1UL<<STAT_PROFILE_PREHEAT)|\
+																(1UL<<STAT_PROFILE_SOAK)|\
+																(1UL<<STAT_PROFILE_RAMPUP)|\
+																(1UL<<STAT_PROFILE_PEAK)|\
+																(1UL<<STAT_PROFILE_RAMPDOWN)))
+#define STAT_SETPFSTAGE(s)		STAT_MODIFY(statusflags=(statusflags&~(\
+																(1UL<<STAT_PROFILE_PREHEAT)|\
+																(1UL<<STAT_PROFILE_SOAK)|\
+																(1UL<<STAT_PROFILE_RAMPUP)|\
+																(1UL<<STAT_PROFILE_PEAK)|\
+																(1UL<<STAT_PROFILE_RAMPDOWN)))|\
+																(1UL<<(STAT_PROFILE_PREHEAT+(s))))
+#define STAT_CLRPFEND()				STAT_MODIFY(statusflags&=~(\
+																(1UL<<STAT_PROFILE_COMPLETE)|\
+																(1UL<<STAT_PROFILE_CANCEL)|\
+																(1UL<<STAT_PROFILE_NO_TC)))
+#define STAT_CLRMENU()				STAT_MODIFY(statusflags&=~((1UL<<STAT_MAIN_MENU)|\
+															(1UL<<STAT_SETTINGS_MENU)|(1UL<<STAT_UNITS_MENU)))
+#define STAT_CLRALL()					STAT_MODIFY(statusflags=0x00000000)
+#define STAT_CLRCOOL()				STAT_MODIFY(statusflags&=~((1UL<<STAT_COOLING)|\
+															(1UL<<STAT_SAFE_OPEN)))
+#define STAT_CLRALLBUTCOOL()	STAT_MODIFY(statusflags&=((1UL<<STAT_COOLING)|\
+															(1UL<<STAT_SAFE_OPEN)))
 #define STAT_DOOR_OPEN				0
 #define STAT_TC_ERROR					1
 #define STAT_CANCEL						2
@@ -110,6 +198,14 @@ volatile uint16_t statusflags = 0x0000;
 #define STAT_PROFILE_CANCEL		11
 #define STAT_ABOUT						12
 #define STAT_COMING_SOON			13
+#define STAT_AUTOTUNE					14
+#define STAT_CHARACTERIZE			15
+#define STAT_STANDBY					16
+#define STAT_COOLING					17
+#define STAT_SAFE_OPEN				18
+#define STAT_FAULT						19
+#define STAT_TC_FLAKY					20
+#define STAT_CALIBRATE				21
                               
 /* Menu status flags */
 volatile uint8_t menuflag = 0x00;
@@ -122,9 +218,20 @@ volatile uint8_t menuflag = 0x00;
 #define MENU_SETTINGS					3
 #define MENU_UNITS						4
 #define MENU_SOUNDS						5
+#define MENU_STANDBY					6
+#define MENU_BATCH						7
+#define MENU_BATCHCOUNT				8
+#define MENU_RESUME						9
+#define MENU_CALIBRATE				10
+#define MENU_FILTER						11
+#define MENU_PROBE						12
 
 /* EEPROM flags */
 #define EEPROM_START_ADDR		(uint8_t*)0x00
+#define EEPROM_RESET_ADDR		(uint8_t*)0x01
+#define EEPROM_WDTCOUNT_ADDR	(uint8_t*)0x02
+#define EEPROM_FILTER_ADDR	(uint8_t*)0x03
+#define EEPROM_PROBE_ADDR		(uint8_t*)0x04
 volatile uint8_t eepromflags = 0x00;
 #define EEPROM(f)						(eepromflags&EEPROM_##f)
 #define EEPROM_UNINIT()			(eepromflags==0xFF)
@@ -148,6 +255,16 @@ volatile uint8_t eepromflags = 0x00;
 #define EEPROM_BUZZER_LOW		(0b0001000)
 #define EEPROM_BUZZER_MED		(0b0010000)
 #define EEPROM_BUZZER_HIGH	(0b0011000)
+#define EEPROM_STANDBY			(0b1100000)
+#define EEPROM_STANDBY_OFF	(0b0000000)
+#define EEPROM_STANDBY_LOW	(0b0100000)
+#define EEPROM_STANDBY_MED	(0b1000000)
+#define EEPROM_STANDBY_HIGH	(0b1100000)
+#define EEPROM_PID_ADDR			(void*)0x10
+#define EEPROM_MODEL_ADDR		(void*)0x18
+#define EEPROM_RUN_ADDR			(void*)0x20
+#define EEPROM_CHECKPOINT_ADDR	(void*)0x40
+#define EEPROM_CAL_ADDR			(void*)0x90
 
 // Button states for PORTD
 volatile uint8_t pd_prev = 0xFF;
@@ -167,33 +284,161 @@ volatile uint8_t pd_prev = 0xFF;
 #define BUZZER_TIME_COMPLETE			500
 #define BUZZER_TIME_DOOR_TC_ERROR	1000
 
+// Warm standby temperature for the EEPROM_STANDBY_* settings
+#define STANDBY_TEMP_LOW					80
+#define STANDBY_TEMP_STEP					20
+#define STANDBY_TEMP(f)						(STANDBY_TEMP_LOW+STANDBY_TEMP_STEP*(((f)>>5)-1))
+
+/* Reset causes, as recorded in EEPROM */
+#define RESET_POWERON							0
+#define RESET_EXTERNAL						1
+#define RESET_BROWNOUT						2
+#define RESET_WATCHDOG						3
+
+/* Door opened during a run */
+#define DOOR_PAUSE_MAX						30	// Seconds the door may stay open before the run aborts
+#define DOOR_RESUME_CATCHUP				1		// Wind the setpoint back to the oven on resume
 
+#if DOOR_PAUSE_MAX > 60
+	#error "Door pause window must be 60s or less"
+#endif
 
+/* Batch run states */
+#define BATCH_IDLE								0
+#define BATCH_RUNNING							1
+#define BATCH_UNLOAD							2		// Waiting for the door to open and close
+#define BATCH_COOLING							3		// Waiting to cool to the restart temperature
+#define BATCH_RESTART_TEMP				50
+
+#if RATE_SAMPLE*TICK_MS != FILTER_SAMPLE_MS
+	#error "The thermocouple filter windows are sized for a different sample rate"
+#endif
+
+// Samples are blanked for this long after any heater switches. Without
+// zero-crossing alignment the SSR may not switch until the next zero
+// crossing, up to half a period later.
+#if POWER_ZC == POWER_ZC_NONE
+	#define ADC_BLANK_MS						(500/MAINS_HZ+4)
+#else
+	#define ADC_BLANK_MS						4
+#endif
+
+/* Thermocouple inputs, scanned in this order every sample period and
+ * followed by the bandgap reference when it's due. The first channel is
+ * the one calibration is done against. */
+#define TC_CHANNELS								2		// 1 drops the board probe on PC1
+#define TC_AIR										0		// Oven air probe on PC0
+#define TC_BOARD									1		// Board surface probe on PC1
+#define TC_MIX_BITS								7		// Channel weights, 128 is all of it
+
+#if TC_CHANNELS == 2
+	#define TC_MUX_LIST							{ 0x00, 0x01 }
+#elif TC_CHANNELS == 1
+	#define TC_MUX_LIST							{ 0x00 }
+#else
+	#error "TC_CHANNELS must be 1 or 2"
+#endif
+
+/* Sensor calibration */
+#define CALIBRATE_REF_MAX					300	// Highest actual temperature that can be entered
+
+
+
+static inline double convert_temp(double c, char *tempsymbol);
 static inline void show_temp_report(void);
 static inline void show_menu(void);
 static inline void show_thermocouple_error(void);
 static inline void show_door_open(void);
+static inline void show_heater_fault(void);
+static inline void show_reset_cause(uint8_t cause);
+static inline void show_run_paused(uint8_t secs);
 static inline void show_cancel_timer(void);
 static inline void show_profile_state(void);
 static inline void show_profile_completion(void);
 static inline void show_about(void);
 static inline void show_coming_soon(void);
+static inline void show_autotune_state(void);
+static inline void show_characterize_state(void);
+static inline void show_calibrate_state(void);
+static inline void show_run_result(void);
+static inline void show_batch_state(void);
+static inline void show_safe_to_open(void);
+static inline void show_run_energy(void);
+static inline void save_run_record(uint8_t id);
 
 static inline void start_buzzer(uint8_t cnt, uint16_t ms);
 
 static inline void reset_profile_state(void);
 static inline void reset_cancel_timer(void);
 static inline void reset_all(void);
+static inline uint8_t record_reset_cause(void);
+
+static inline bool start_profile(uint8_t id, const checkpoint_t *cp);
+static inline bool offer_resume(void);
+static inline void update_checkpoint(void);
+static inline void load_pid_gains(void);
+static inline void load_oven_model(void);
+static inline void load_filter(void);
+static inline void load_probe_mix(void);
+static inline void start_autotune(void);
+static inline void start_characterize(void);
+static inline void start_calibrate(uint8_t slot);
+static inline void finish_calibrate(void);
+static inline void start_standby(void);
+static inline void stop_standby(void);
+static inline void start_batch_cooling(void);
+static inline void update_batch(void);
+static inline bool pause_profile(void);
+
+static inline void run_deferred_tasks(void);
+static inline void update_setpoint(void);
+static inline bool heater_enabled(void);
+static inline void update_control(void);
+static inline void update_fan(uint8_t duty);
+static inline void sample_thermocouple(uint8_t ch, uint16_t reading, bool blanked);
+static inline void update_temperature(void);
 
 
 
-#define NUM_AVERAGE 16
-static volatile uint16_t adc_average[NUM_AVERAGE];
-static volatile uint8_t average_count = 0;
+static volatile bool adc_blanked = false;
+static tcfault_t tcf[TC_CHANNELS];
+static filter_t tcfilter[TC_CHANNELS];
+static uint8_t tc_faults[TC_CHANNELS];
+static volatile uint16_t tc_q4[TC_CHANNELS];
+static volatile int16_t tc_temp[TC_CHANNELS];
+static volatile uint8_t tc_mix[TC_CHANNELS];
+static supply_t supply;
 
 static volatile uint16_t temperature = 0;
-static volatile double targettemp = 0;
+static volatile int16_t temperature_fx = 0;
+static volatile int16_t targettemp = 0;
+static pidctrl_t pid;
+static autotune_t tune;
+static uint8_t autotune_shown = AUTOTUNE_IDLE;
+static volatile uint16_t ffdemand = 0;
+static ovenmodel_t model;
+static characterize_t charrun;
+static uint8_t characterize_shown = CHAR_IDLE;
+static estimator_t est;
+static uint16_t lastdemand = 0;
+static cooler_t cool;
+static energy_t energy;
+static protect_t prot;
+static checkpoint_t resumecp;
+static uint8_t checkpoint_index = 0xFF;
+static uint32_t checkpoint_ms = 0;
+static bool safe_shown = false;
+static bool flaky_shown = false;
+static profile_t setpoints;
+static volatile uint8_t batchstate = BATCH_IDLE;
+static uint8_t batchprofile = 0;
+static uint8_t batchcount = 0;
+static uint8_t batchrun = 0;
+static uint8_t calslot = CAL_LOW;
+static int16_t calref = 0;
+static bool calrejected = false;
 static volatile uint32_t time_ms = 0;
+static volatile uint16_t pause_ms = 0;
 static volatile uint8_t ctovf_count = 0;
 static volatile uint8_t debounce_count = 0;
 static volatile uint8_t buzzer_count = 0;
@@ -0,0 +1,32 @@
+#include "supply.h"
+
+// Tracks the supply from bandgap readings without a division. The reading
+// the bandgap would give at the nominal supply is fixed, so the bandgap
+// scaled by the current gain should land on it; whatever it misses by is
+// fed back into the gain. Each reading takes out about a ninth of the error,
+// so a step in the supply is followed to within 10% in about 20 readings
+// (160ms), smoothing the bandgap's own quantisation along the way. The bandgap's tolerance
+// from chip to chip is a fixed gain error, which calibration takes out.
+
+#define SUPPLY_TARGET		((uint16_t)((uint32_t)SUPPLY_BANDGAP_MV*1024*16/SUPPLY_NOMINAL_MV))	// Q4 counts
+
+void supply_init(supply_t *s) {
+	s->gain = 1<<SUPPLY_GAIN_BITS;
+	s->bandgap = SUPPLY_BANDGAP(SUPPLY_NOMINAL_MV);
+}
+
+void supply_sample(supply_t *s, uint16_t reading) {
+	// A lower supply gives a higher bandgap reading
+	if(reading>SUPPLY_BANDGAP(SUPPLY_MIN_MV) || reading<SUPPLY_BANDGAP(SUPPLY_MAX_MV))
+		return;
+	s->bandgap = reading;
+	int16_t scaled = ((uint32_t)(reading<<4)*s->gain)>>SUPPLY_GAIN_BITS;
+	int16_t miss = SUPPLY_TARGET-scaled;
+	s->gain += miss>>SUPPLY_GAIN_SHIFT;
+}
+
+// Scale a Q4 thermocouple reading to what it would be at the nominal supply
+uint16_t supply_correct(const supply_t *s, uint16_t adc) {
+	uint32_t c = ((uint32_t)adc*s->gain)>>SUPPLY_GAIN_BITS;
+	return (c>UINT16_MAX)?UINT16_MAX:c;
+}
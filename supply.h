@@ -0,0 +1,29 @@
+#ifndef SUPPLY_H
+#define SUPPLY_H
+
+#include <inttypes.h>
+
+/* Supply compensation. The ADC uses AVcc as its reference, so the 1.1V
+ * bandgap is read against it every few samples to find what AVcc really is
+ * and scale thermocouple readings back to the nominal supply. */
+#define SUPPLY_NOMINAL_MV			5000
+#define SUPPLY_BANDGAP_MV			1100
+#define SUPPLY_MIN_MV					4000		// Bandgap readings outside this are ignored
+#define SUPPLY_MAX_MV					5500
+#define SUPPLY_INTERVAL				4				// Thermocouple samples between bandgap readings
+#define SUPPLY_GAIN_BITS			14			// Correction factor, Q14
+#define SUPPLY_GAIN_SHIFT			1				// Correction step, higher is smoother
+
+// Bandgap reading in counts for a given supply
+#define SUPPLY_BANDGAP(mv)		((uint16_t)((uint32_t)SUPPLY_BANDGAP_MV*1024/(mv)))
+
+typedef struct {
+	uint16_t gain;				// Actual over nominal supply, Q14
+	uint16_t bandgap;			// Last accepted bandgap reading, counts
+} supply_t;
+
+void supply_init(supply_t *s);
+void supply_sample(supply_t *s, uint16_t reading);
+uint16_t supply_correct(const supply_t *s, uint16_t adc);
+
+#endif // SUPPLY_H
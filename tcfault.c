@@ -0,0 +1,60 @@
+#include "tcfault.h"
+
+// Classifies every raw thermocouple sample as it arrives, in constant time,
+// so a failing sensor is caught long before the averaged temperature goes
+// out of range. A reading pinned to either rail is a broken or shorted
+// thermocouple. A step larger than the oven could possibly make between two
+// samples is a glitch and is kept out of the average. Noise is tracked as
+// the mean squared step between samples, which ignores the real trend. Each
+// glitch or noisy sample adds to a leaky score, so an intermittent
+// connection is flagged as flaky first and failed if it keeps up.
+
+void tcf_reset(tcfault_t *t) {
+	t->prev = 0;
+	t->var = 0;
+	t->stuck = t->glitches = t->score = 0;
+	t->primed = 0;
+}
+
+uint8_t tcf_sample(tcfault_t *t, uint16_t reading) {
+	uint8_t flags = 0;
+	
+	if(reading<=TCF_RAIL_LOW || reading>=TCF_RAIL_HIGH) {
+		if(t->stuck<TCF_RAIL_SAMPLES) t->stuck++;
+	} else {
+		t->stuck = 0;
+	}
+	
+	if(!t->primed) {
+		t->prev = reading;
+		t->primed = 1;
+	}
+	int16_t step = reading-t->prev;
+	if(step<0) step = -step;
+	
+	uint8_t bad = 0;
+	if(step>TCF_MAX_STEP) {
+		// Impossible for the oven, so it's the wiring; after a few in a row
+		// take it as the new level and let the score speak for it
+		bad = TCF_SCORE_GLITCH;
+		if(++t->glitches>=TCF_REPRIME) {
+			t->glitches = 0;
+			t->prev = reading;
+		} else {
+			flags |= TCF_GLITCH;
+		}
+	} else {
+		t->glitches = 0;
+		uint16_t sq = (step*step)<<4;
+		t->var += ((int16_t)(sq-t->var))>>TCF_VAR_SHIFT;
+		t->prev = reading;
+		if(t->var>TCF_VAR_MAX) bad = TCF_SCORE_NOISY;
+	}
+	
+	if(bad)						t->score = (t->score>0xFF-bad)?0xFF:t->score+bad;
+	else if(t->score)	t->score--;
+	
+	if(t->score>=TCF_SCORE_WARN)																	flags |= TCF_FLAKY;
+	if(t->score>=TCF_SCORE_FAULT || t->stuck>=TCF_RAIL_SAMPLES)	flags |= TCF_FAULT;
+	return flags;
+}
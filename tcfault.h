@@ -0,0 +1,36 @@
+#ifndef TCFAULT_H
+#define TCFAULT_H
+
+#include <inttypes.h>
+
+/* Thermocouple fault classification, in raw ADC counts */
+#define TCF_RAIL_LOW				1				// At or below: shorted or lost supply
+#define TCF_RAIL_HIGH				1022		// At or above: open thermocouple
+#define TCF_RAIL_SAMPLES		8				// Consecutive rail samples for a fault
+#define TCF_MAX_STEP				8				// Largest believable change between samples
+#define TCF_REPRIME					4				// Accept a new level after this many glitches
+#define TCF_VAR_SHIFT				4				// Noise averaging, 1/16
+#define TCF_VAR_MAX					512			// Noise limit, Q4 squared counts between samples
+#define TCF_SCORE_GLITCH		16			// Added for an impossible step
+#define TCF_SCORE_NOISY			2				// Added for a sample while too noisy
+#define TCF_SCORE_WARN			64			// Flag the sensor as flaky
+#define TCF_SCORE_FAULT			192			// Treat it as failed
+
+/* Per-sample result flags */
+#define TCF_GLITCH					(1<<0)	// Leave this sample out of the average
+#define TCF_FLAKY						(1<<1)
+#define TCF_FAULT						(1<<2)
+
+typedef struct {
+	uint16_t prev;				// Last accepted reading
+	uint16_t var;					// Mean squared step, Q4
+	uint8_t stuck;				// Consecutive samples at a rail
+	uint8_t glitches;			// Consecutive rejected samples
+	uint8_t score;				// Leaky count of bad samples
+	uint8_t primed;
+} tcfault_t;
+
+void tcf_reset(tcfault_t *t);
+uint8_t tcf_sample(tcfault_t *t, uint16_t reading);
+
+#endif // TCFAULT_H
@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <avr/eeprom.h>
+
+#include "globals.h"
+#include "calibrate.h"
+
+// Host tests for the thermocouple calibration. Build and run with "make" in
+// this directory.
+
+#define CHECK(c)	do { if(!(c)) { printf("%s:%d: %s\n", __FILE__, __LINE__, #c); failures++; } } while(0)
+
+#define BASE		((void*)0x20)
+#define STEP		(1<<CAL_STEP_BITS)
+
+uint8_t eeprom_image[EEPROM_STUB_SIZE];
+
+static int failures = 0;
+static int16_t deflt[1<<CAL_IN_BITS];
+
+static void test_default(void) {
+	// Uncalibrated it follows the K-type table, rising all the way
+	memset(eeprom_image, 0xFF, sizeof(eeprom_image));
+	cal_load(BASE);
+	CHECK(cal_lookup(0)==TEMP_FX(0.0));
+	CHECK(cal_lookup(STEP)==TEMP_FX(31.3));
+	CHECK(cal_lookup(STEP+STEP/2)==(TEMP_FX(31.3)+TEMP_FX(62.3))/2);
+	CHECK(cal_lookup((1<<CAL_IN_BITS)-1)<=TEMP_FX(988.6));
+	for(uint16_t a=0; a<(1<<CAL_IN_BITS); a++) {
+		deflt[a] = cal_lookup(a);
+		if(a) CHECK(deflt[a]>=deflt[a-1]);
+	}
+}
+
+static void test_offset(void) {
+	// One point shifts the whole curve
+	memset(eeprom_image, 0xFF, sizeof(eeprom_image));
+	cal_load(BASE);
+	uint16_t at = 7*STEP+100;
+	CHECK(cal_capture(BASE, CAL_LOW, at, deflt[at]+TEMP_FX(5)));
+	for(uint16_t a=0; a<(1<<CAL_IN_BITS); a+=97)
+		CHECK(abs(cal_lookup(a)-(deflt[a]+TEMP_FX(5)))<=1);
+}
+
+static void test_two_point(void) {
+	// Two points are met exactly, with the error interpolated between them
+	// and carried on past them
+	memset(eeprom_image, 0xFF, sizeof(eeprom_image));
+	cal_load(BASE);
+	uint16_t lo = 3*STEP+40, hi = 8*STEP+300;
+	CHECK(cal_capture(BASE, CAL_LOW, lo, deflt[lo]+TEMP_FX(2)));
+	CHECK(cal_capture(BASE, CAL_HIGH, hi, deflt[hi]-TEMP_FX(4)));
+	CHECK(abs(cal_lookup(lo)-(deflt[lo]+TEMP_FX(2)))<=1);
+	CHECK(abs(cal_lookup(hi)-(deflt[hi]-TEMP_FX(4)))<=1);
+	uint16_t mid = (lo+hi)/2;
+	CHECK(abs(cal_lookup(mid)-(deflt[mid]-TEMP_FX(1)))<=2);
+	
+	// It survives a reset, and a damaged table falls back to the default
+	cal_load(BASE);
+	CHECK(abs(cal_lookup(hi)-(deflt[hi]-TEMP_FX(4)))<=1);
+	eeprom_image[(uintptr_t)BASE+1] ^= 0x01;
+	cal_load(BASE);
+	CHECK(cal_lookup(hi)==deflt[hi]);
+}
+
+static void test_refuse(void) {
+	// Points too close together would give a wild gain
+	memset(eeprom_image, 0xFF, sizeof(eeprom_image));
+	cal_load(BASE);
+	CHECK(cal_capture(BASE, CAL_LOW, 5*STEP, TEMP_FX(150)));
+	CHECK(!cal_capture(BASE, CAL_HIGH, 5*STEP+CAL_MIN_SPAN-1, TEMP_FX(160)));
+	// Replacing the same slot is always allowed
+	CHECK(cal_capture(BASE, CAL_LOW, 5*STEP+1, TEMP_FX(151)));
+	
+	cal_reset(BASE);
+	CHECK(cal_lookup(5*STEP)==deflt[5*STEP]);
+	cal_load(BASE);
+	CHECK(cal_lookup(5*STEP)==deflt[5*STEP]);
+}
+
+int main(void) {
+	test_default();
+	test_offset();
+	test_two_point();
+	test_refuse();
+	if(failures) {
+		printf("%d failed\n", failures);
+		return EXIT_FAILURE;
+	}
+	printf("calibrate tests passed\n");
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,98 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <avr/eeprom.h>
+
+#include "checkpoint.h"
+
+// Host tests for the run checkpoints. Build and run with "make" in this
+// directory.
+
+#define CHECK(c)	do { if(!(c)) { printf("%s:%d: %s\n", __FILE__, __LINE__, #c); failures++; } } while(0)
+
+#define BASE		((void*)0x40)
+
+uint8_t eeprom_image[EEPROM_STUB_SIZE];
+
+static int failures = 0;
+
+static checkpoint_t *slot(uint8_t i) {
+	return (checkpoint_t*)&eeprom_image[(uintptr_t)BASE]+i;
+}
+
+static void save(uint8_t profile, uint16_t elapsed) {
+	checkpoint_t cp;
+	memset(&cp, 0, sizeof(cp));
+	cp.profile = profile;
+	cp.elapsed = elapsed;
+	checkpoint_save(BASE, &cp);
+}
+
+static void test_blank(void) {
+	// A fresh EEPROM reads as erased, which isn't a run
+	checkpoint_t cp;
+	memset(eeprom_image, 0xFF, sizeof(eeprom_image));
+	CHECK(!checkpoint_load(BASE, &cp));
+	CHECK(cp.profile==CHECKPOINT_NONE);
+}
+
+static void test_ring_wrap(void) {
+	// Go round the slots enough times for the sequence number to wrap too,
+	// and the newest must always be the one found after a reset
+	checkpoint_t cp;
+	memset(eeprom_image, 0xFF, sizeof(eeprom_image));
+	checkpoint_load(BASE, &cp);
+	for(uint16_t n=1; n<=600; n++) {
+		save(2, n);
+		CHECK(checkpoint_load(BASE, &cp));
+		CHECK(cp.profile==2 && cp.elapsed==n);
+	}
+	// Every slot has been written
+	for(uint8_t i=0; i<CHECKPOINT_SLOTS; i++)
+		CHECK(slot(i)->profile==2);
+}
+
+static void test_crc_reject(void) {
+	// A slot torn by a power cut falls back to the one before it
+	checkpoint_t cp;
+	memset(eeprom_image, 0xFF, sizeof(eeprom_image));
+	checkpoint_load(BASE, &cp);
+	for(uint16_t n=1; n<=6; n++) save(3, n);
+	uint8_t newest = 6%CHECKPOINT_SLOTS;	// Erased, the first save went to slot 1
+	CHECK(slot(newest)->elapsed==6);
+	slot(newest)->elapsed ^= 0x0100;
+	CHECK(checkpoint_load(BASE, &cp));
+	CHECK(cp.elapsed==5);
+	
+	// With both torn there's nothing to resume
+	uint8_t prev = newest?newest-1:CHECKPOINT_SLOTS-1;
+	slot(prev)->tal ^= 0x0001;
+	CHECK(!checkpoint_load(BASE, &cp));
+}
+
+static void test_clear(void) {
+	// Clearing records that no run is in progress, and only writes if one was
+	checkpoint_t cp;
+	memset(eeprom_image, 0xFF, sizeof(eeprom_image));
+	checkpoint_load(BASE, &cp);
+	save(1, 10);
+	checkpoint_clear(BASE);
+	CHECK(!checkpoint_load(BASE, &cp));
+	uint8_t before[EEPROM_STUB_SIZE];
+	memcpy(before, eeprom_image, sizeof(before));
+	checkpoint_clear(BASE);
+	CHECK(memcmp(before, eeprom_image, sizeof(before))==0);
+}
+
+int main(void) {
+	test_blank();
+	test_ring_wrap();
+	test_crc_reject();
+	test_clear();
+	if(failures) {
+		printf("%d failed\n", failures);
+		return EXIT_FAILURE;
+	}
+	printf("checkpoint tests passed\n");
+	return EXIT_SUCCESS;
+}
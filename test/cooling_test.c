@@ -0,0 +1,83 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "globals.h"
+#include "cooling.h"
+
+// Host tests for the closed-loop cooling. Build and run with "make" in this
+// directory.
+
+#define CHECK(c)	do { if(!(c)) { printf("%s:%d: %s\n", __FILE__, __LINE__, #c); failures++; } } while(0)
+
+#define DT_MS		10
+
+static int failures = 0;
+
+static void test_on_setpoint(void) {
+	// On the setpoint, or below it, the fan stays off
+	cooler_t c;
+	cool_init(&c, DT_MS);
+	cool_reset(&c, TEMP_FX(200));
+	for(uint16_t i=0; i<1000; i++) {
+		CHECK(cool_update(&c, TEMP_FX(200), TEMP_FX(200), 0)==0);
+		CHECK(cool_update(&c, TEMP_FX(200), TEMP_FX(190), 0)==0);
+	}
+}
+
+static void test_hot(void) {
+	// Well above the setpoint the fan runs, and flat out if it stays there
+	cooler_t c;
+	cool_init(&c, DT_MS);
+	cool_reset(&c, TEMP_FX(200));
+	uint8_t duty = cool_update(&c, TEMP_FX(180), TEMP_FX(190), 0);
+	CHECK(duty>=COOLING_MIN_DUTY);
+	for(uint16_t i=0; i<3000; i++) duty = cool_update(&c, TEMP_FX(180), TEMP_FX(190), 0);
+	CHECK(duty==255);
+}
+
+static void test_small_error(void) {
+	// A small error too weak to start the fan builds up until it does
+	cooler_t c;
+	cool_init(&c, DT_MS);
+	cool_reset(&c, TEMP_FX(200));
+	CHECK(cool_update(&c, TEMP_FX(199), TEMP_FX(200), 0)==0);
+	uint16_t i;
+	for(i=0; i<10000; i++)
+		if(cool_update(&c, TEMP_FX(199), TEMP_FX(200), 0)) break;
+	CHECK(i<10000);
+}
+
+static void test_too_fast(void) {
+	// Cooling faster than the paste allows backs the fan off whatever the error
+	cooler_t c;
+	cool_init(&c, DT_MS);
+	cool_reset(&c, TEMP_FX(200));
+	for(uint16_t i=0; i<1000; i++) cool_update(&c, TEMP_FX(150), TEMP_FX(200), 0);
+	CHECK(cool_update(&c, TEMP_FX(150), TEMP_FX(200), -TEMP_FX(COOLING_MAX_RATE+1))==0);
+}
+
+static void test_ramp_down(void) {
+	// With no setpoint the target carries on down at COOLING_RATE
+	cooler_t c;
+	cool_init(&c, DT_MS);
+	cool_reset(&c, TEMP_FX(200));
+	for(uint16_t i=0; i<10000/DT_MS; i++) cool_update(&c, COOL_NO_SETPOINT, TEMP_FX(150), 0);
+	CHECK(abs((int32_t)(c.sp>>8)-TEMP_FX(200-10*COOLING_RATE))<=TEMP_FX(0.5));
+	// and stops at zero
+	for(uint16_t i=0; i<60000; i++) cool_update(&c, COOL_NO_SETPOINT, 0, 0);
+	CHECK(c.sp==0);
+}
+
+int main(void) {
+	test_on_setpoint();
+	test_hot();
+	test_small_error();
+	test_too_fast();
+	test_ramp_down();
+	if(failures) {
+		printf("%d failed\n", failures);
+		return EXIT_FAILURE;
+	}
+	printf("cooling tests passed\n");
+	return EXIT_SUCCESS;
+}
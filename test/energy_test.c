@@ -0,0 +1,73 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "pid.h"
+#include "energy.h"
+
+// Host tests for the heater energy accounting. Build and run with "make" in
+// this directory.
+
+#define CHECK(c)	do { if(!(c)) { printf("%s:%d: %s\n", __FILE__, __LINE__, #c); failures++; } } while(0)
+
+#define TICK_MS		1
+
+static int failures = 0;
+
+// Run a stage for some seconds with the heater on for "on" ticks in "of"
+static void run(energy_t *e, uint8_t stage, uint16_t secs, uint8_t on, uint8_t of) {
+	for(uint32_t i=0; i<(uint32_t)secs*1000/TICK_MS; i++)
+		energy_tick(e, stage, (i%of<on)?1:0, TICK_MS);
+}
+
+static void test_duty(void) {
+	// Duty per stage is what the heater got, averaged over the channels
+	energy_t e;
+	energy_reset(&e);
+	run(&e, STAGE_PREHEAT, 30, 1, 1);
+	run(&e, STAGE_SOAK, 60, 1, 2);
+	run(&e, STAGE_RAMPUP, 20, 3, 4);
+	CHECK(energy_duty(&e, STAGE_PREHEAT)==POWER_MAX/POWER_CHANNELS);
+	CHECK(energy_duty(&e, STAGE_SOAK)==POWER_MAX/2/POWER_CHANNELS);
+	CHECK(energy_duty(&e, STAGE_RAMPUP)==POWER_MAX*3/4/POWER_CHANNELS);
+	CHECK(energy_duty(&e, STAGE_PEAK)==0);
+	CHECK(energy_duty(&e, STAGE_COUNT)==0);
+}
+
+static void test_energy(void) {
+	// Six minutes on at the rated power, in tenths of a watt-hour
+	energy_t e;
+	energy_reset(&e);
+	run(&e, STAGE_SOAK, 360, 1, 1);
+	CHECK(energy_total(&e)==(uint32_t)ENERGY_CHANNEL_WATTS*360*10/3600);
+	
+	// A stage past the end is ignored rather than written out of bounds
+	energy_tick(&e, STAGE_COUNT, 1, TICK_MS);
+	CHECK(energy_total(&e)==(uint32_t)ENERGY_CHANNEL_WATTS*360*10/3600);
+}
+
+static void test_record(void) {
+	energy_t e;
+	runrecord_t r;
+	energy_reset(&e);
+	energy_demand(&e, 400);
+	energy_demand(&e, 950);
+	energy_demand(&e, 200);
+	run(&e, STAGE_SOAK, 90, 1, 4);
+	energy_record(&e, &r);
+	CHECK(r.peak_duty==950);
+	CHECK(r.soak_duty==POWER_MAX/4/POWER_CHANNELS);
+	CHECK(r.on_secs[STAGE_SOAK]==22);
+	CHECK(r.on_secs[STAGE_PREHEAT]==0);
+}
+
+int main(void) {
+	test_duty();
+	test_energy();
+	test_record();
+	if(failures) {
+		printf("%d failed\n", failures);
+		return EXIT_FAILURE;
+	}
+	printf("energy tests passed\n");
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,86 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "globals.h"
+#include "pid.h"
+#include "estimator.h"
+
+// Host tests for the thermocouple lag compensation. Build and run with "make"
+// in this directory.
+
+#define CHECK(c)	do { if(!(c)) { printf("%s:%d: %s\n", __FILE__, __LINE__, #c); failures++; } } while(0)
+
+#define DT_MS		10
+
+static int failures = 0;
+
+// Oven with no dead time, so the model is exact
+static const ovenmodel_t oven = { 200, 120, 0, TEMP_FX(25) };
+
+// Thermocouple following the true temperature through its first-order lag
+static float sense(float tc, float t) {
+	return tc+(t-tc)*DT_MS/EST_SENSOR_TAU_MS;
+}
+
+static void test_steady(void) {
+	// A steady reading gives itself back with no slope
+	estimator_t est;
+	est_init(&est, DT_MS);
+	est_reset(&est, TEMP_FX(150));
+	for(uint16_t i=0; i<1000; i++) est_update(&est, TEMP_FX(150), 0, 0);
+	CHECK(est.temp==TEMP_FX(150));
+	CHECK(est.tempslope==0);
+}
+
+static void test_ramp(void) {
+	// On a steady ramp the thermocouple trails by rate*tau; the estimate
+	// has to take that back out and report the rate
+	estimator_t est;
+	est_init(&est, DT_MS);
+	est_reset(&est, TEMP_FX(25));
+	float t = 25, tc = 25;
+	for(uint32_t i=0; i<120000/DT_MS; i++) {
+		t += 1.5*DT_MS/1000;
+		tc = sense(tc, t);
+		est_update(&est, TEMP_FX(tc), 0, 0);
+	}
+	CHECK(t-tc>3);	// The lag is really there
+	CHECK(abs(est.temp-TEMP_FX(t))<=TEMP_FX(0.5));
+	CHECK(abs(est.tempslope-TEMP_FX(1.5))<=TEMP_FX(0.2));
+}
+
+static void test_model_step(void) {
+	// Switching the heater on: with the model the estimate follows the true
+	// temperature closely from the start, and never does worse than without
+	estimator_t with, without;
+	est_init(&with, DT_MS);
+	est_init(&without, DT_MS);
+	est_reset(&with, oven.ambient);
+	est_reset(&without, oven.ambient);
+	float t = 25, tc = 25, worst_with = 0, worst_without = 0;
+	for(uint32_t i=0; i<60000/DT_MS; i++) {
+		t += (25+oven.gain-t)*DT_MS/(oven.tau*1000.0);
+		tc = sense(tc, t);
+		est_update(&with, TEMP_FX(tc), POWER_MAX, &oven);
+		est_update(&without, TEMP_FX(tc), POWER_MAX, 0);
+		float e = abs(with.temp-TEMP_FX(t))/16.0;
+		if(e>worst_with) worst_with = e;
+		e = abs(without.temp-TEMP_FX(t))/16.0;
+		if(i>=10000/DT_MS && e>worst_without) worst_without = e;
+		if(i>=10000/DT_MS) CHECK(abs(with.temp-TEMP_FX(t))<=TEMP_FX(1));
+	}
+	CHECK(worst_with<1);
+	CHECK(worst_with<=worst_without+0.5);
+}
+
+int main(void) {
+	test_steady();
+	test_ramp();
+	test_model_step();
+	if(failures) {
+		printf("%d failed\n", failures);
+		return EXIT_FAILURE;
+	}
+	printf("estimator tests passed\n");
+	return EXIT_SUCCESS;
+}
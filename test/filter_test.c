@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "filter.h"
+
+// Host tests for the thermocouple filter chain. Build and run with "make" in
+// this directory.
+
+#define CHECK(c)	do { if(!(c)) { printf("%s:%d: %s\n", __FILE__, __LINE__, #c); failures++; } } while(0)
+
+static int failures = 0;
+
+static void test_median(void) {
+	// Every ordering of five readings gives the middle one
+	static const uint16_t v[5] = { 10, 20, 30, 40, 50 };
+	uint8_t idx[5] = { 0, 1, 2, 3, 4 };
+	for(uint16_t n=0; n<120; n++) {
+		// nth permutation, factorial number system
+		uint8_t pool[5] = { 0, 1, 2, 3, 4 }, left = 5;
+		uint16_t k = n;
+		for(uint8_t i=0; i<5; i++) {
+			uint8_t f = 1;
+			for(uint8_t j=2; j<left; j++) f *= j;
+			uint8_t p = k/f;
+			k %= f;
+			idx[i] = pool[p];
+			for(uint8_t j=p; j<left-1; j++) pool[j] = pool[j+1];
+			left--;
+		}
+		filter_t f;
+		filter_init(&f, FILTER_MEDIAN_5);
+		filter_sample(&f, 0, true);
+		uint16_t out = 0;
+		for(uint8_t i=0; i<5; i++) out = filter_sample(&f, v[idx[i]], true);
+		CHECK(out==30<<4);
+	}
+	
+	// A single spike doesn't get through either median
+	filter_t f3, f5;
+	filter_init(&f3, FILTER_MEDIAN_3);
+	filter_init(&f5, FILTER_MEDIAN_5);
+	for(uint8_t i=0; i<10; i++) {
+		uint16_t r = (i==6)?1000:100;
+		CHECK(filter_sample(&f3, r, true)==100<<4);
+		CHECK(filter_sample(&f5, r, true)==100<<4);
+	}
+}
+
+static void test_box_step(void) {
+	// The box ramps linearly over its window and then holds
+	filter_t f;
+	filter_init(&f, FILTER_BOX);
+	filter_sample(&f, 100, true);
+	for(uint8_t k=1; k<=FILTER_WINDOW*2; k++) {
+		uint16_t out = filter_sample(&f, 200, true);
+		uint8_t n = (k<FILTER_WINDOW)?k:FILTER_WINDOW;
+		uint16_t want = (uint32_t)(100*(FILTER_WINDOW-n)+200*n)*16/FILTER_WINDOW;
+		CHECK(abs((int)out-want)<=1);
+	}
+}
+
+static void test_box_mains(void) {
+	// Pickup at the mains frequency sums to nothing, and a reading lost to
+	// a heater switching is stood in for without bringing it back
+	filter_t f;
+	filter_init(&f, FILTER_BOX);
+	for(uint16_t i=0; i<500; i++) {
+		float t = i*FILTER_SAMPLE_MS/1000.0;
+		uint16_t r = 500+lrintf(40*sinf(2*M_PI*MAINS_HZ*t));
+		bool usable = (i%37)!=5;
+		uint16_t out = filter_sample(&f, usable?r:0, usable);
+		if(i>=FILTER_WINDOW) CHECK(abs((int)out-500*16)<=16);
+	}
+}
+
+static void test_iir_step(void) {
+	// The IIR approaches a step steadily, reaching about 1-1/e after 2^n
+	// samples, and settles on it
+	for(uint8_t shift=1; shift<=4; shift++) {
+		filter_t f;
+		filter_init(&f, FILTER_IIR_SHIFT(shift));
+		filter_sample(&f, 100, true);
+		uint16_t prev = 100<<4, out = 0;
+		for(uint16_t k=1; k<=200; k++) {
+			out = filter_sample(&f, 200, true);
+			CHECK(out>=prev && out<=200<<4);
+			if(k==(1U<<shift)) CHECK(out>=(100+62)<<4 && out<=(100+76)<<4);
+			prev = out;
+		}
+		CHECK(out>=(200<<4)-1);
+	}
+}
+
+static void test_delay(void) {
+	CHECK(filter_delay_ms(FILTER_MEDIAN_OFF)==0);
+	CHECK(filter_delay_ms(FILTER_MEDIAN_5)==2*FILTER_SAMPLE_MS);
+	CHECK(filter_delay_ms(FILTER_BOX)==(FILTER_WINDOW-1)*FILTER_SAMPLE_MS/2);
+	CHECK(filter_delay_ms(FILTER_IIR_SHIFT(3))==7*FILTER_SAMPLE_MS);
+}
+
+int main(void) {
+	test_median();
+	test_box_step();
+	test_box_mains();
+	test_iir_step();
+	test_delay();
+	if(failures) {
+		printf("%d failed\n", failures);
+		return EXIT_FAILURE;
+	}
+	printf("filter tests passed\n");
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,57 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "globals.h"
+#include "pid.h"
+#include "model.h"
+
+// Host tests for the oven model. Build and run with "make" in this
+// directory.
+
+#define CHECK(c)	do { if(!(c)) { printf("%s:%d: %s\n", __FILE__, __LINE__, #c); failures++; } } while(0)
+
+#define DT_MS		100
+
+static int failures = 0;
+
+// Characterize a simulated first-order-plus-dead-time oven
+static void characterize(characterize_t *ch, float gain, float tau, uint16_t deadtime) {
+	static uint8_t delay[4000];		// Heater demand history, one per step
+	uint16_t lag = deadtime*1000/DT_MS;
+	float temp = 25;
+	uint16_t u = 0;
+	model_char_start(ch, TEMP_FX(temp), DT_MS);
+	for(uint32_t i=0; i<CHAR_TIMEOUT*1000UL/DT_MS+10; i++) {
+		delay[i%lag] = (u==POWER_MAX);
+		float on = (i>=lag)?delay[(i+1)%lag]:0;
+		temp += (gain*on-(temp-25))*DT_MS/(1000*tau);
+		u = model_char_update(ch, TEMP_FX(temp));
+		if(ch->state!=CHAR_HEATING && ch->state!=CHAR_COOLING) break;
+	}
+}
+
+static void test_quick_oven(void) {
+	characterize_t ch;
+	characterize(&ch, 300, 200, 20);
+	CHECK(ch.state==CHAR_DONE);
+	CHECK(abs((int)ch.result.deadtime-20)<=5);
+}
+
+static void test_slow_oven(void) {
+	characterize_t ch;
+	// The steepest rise comes long after the first 255 samples
+	characterize(&ch, 200, 400, 280);
+	CHECK(ch.state==CHAR_DONE);
+	CHECK(abs((int)ch.result.deadtime-280)<=10);
+}
+
+int main(void) {
+	test_quick_oven();
+	test_slow_oven();
+	if(failures) {
+		printf("%d failed\n", failures);
+		return EXIT_FAILURE;
+	}
+	printf("model tests passed\n");
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,48 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "globals.h"
+#include "pid.h"
+
+// Host tests for the PID controller. Build and run with "make" in this
+// directory.
+
+#define CHECK(c)	do { if(!(c)) { printf("%s:%d: %s\n", __FILE__, __LINE__, #c); failures++; } } while(0)
+
+static int failures = 0;
+
+static const pidgains_t gains = { PID_DEFAULT_KP, PID_DEFAULT_TI, PID_DEFAULT_TD };
+
+static void test_feedforward_trimmed(void) {
+	pidctrl_t pid;
+	pid_init(&pid, &gains, 100);
+	pid_reset(&pid, TEMP_FX(152));
+	// The feedforward asks for half power but the oven holds above setpoint
+	// without any, so the integral has to take it all back
+	uint16_t out = POWER_MAX;
+	for(uint16_t i=0; i<20000; i++)
+		out = pid_update(&pid, TEMP_FX(150), TEMP_FX(152), POWER_MAX/2);
+	CHECK(out==0);
+}
+
+static void test_output_never_negative(void) {
+	pidctrl_t pid;
+	pid_init(&pid, &gains, 100);
+	pid_reset(&pid, TEMP_FX(150));
+	for(uint16_t i=0; i<20000; i++)
+		pid_update(&pid, TEMP_FX(100), TEMP_FX(150), POWER_MAX/4);
+	// Once the feedforward goes, the integral mustn't hold the heater off
+	uint16_t out = pid_update(&pid, TEMP_FX(150), TEMP_FX(149), 0);
+	CHECK(out>0);
+}
+
+int main(void) {
+	test_feedforward_trimmed();
+	test_output_never_negative();
+	if(failures) {
+		printf("%d failed\n", failures);
+		return EXIT_FAILURE;
+	}
+	printf("pid tests passed\n");
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,79 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "pid.h"
+#include "power.h"
+
+// Host tests for the heater output stage. Build and run with "make" in this
+// directory.
+
+#define CHECK(c)	do { if(!(c)) { printf("%s:%d: %s\n", __FILE__, __LINE__, #c); failures++; } } while(0)
+
+#define TICK_MS		1
+
+static int failures = 0;
+
+// Average output over whole windows, per-mille, with the deferred step
+// catching up every "every" ticks. Also checks no pulse or gap is shorter
+// than the SSR is allowed.
+static uint16_t delivered_every(uint16_t demand, uint16_t windows, uint8_t every) {
+	power_init(TICK_MS);
+	power_set(0, demand);
+	uint32_t on = 0, ticks = (uint32_t)windows*POWER_WINDOW_MS/TICK_MS;
+	uint32_t run = 0;
+	uint8_t last = 0;
+	bool switched = false;
+	for(uint32_t i=0; i<ticks; i++) {
+		uint8_t out = power_update()&1;
+		if(out!=last) {
+			// The wait before the first switch isn't a gap the SSR was given
+			if(switched) CHECK(run*TICK_MS>=(last?POWER_MIN_ON_MS:POWER_MIN_OFF_MS));
+			switched = true;
+			last = out;
+			run = 0;
+		}
+		run++;
+		if(out) on++;
+		if(i%every==every-1) power_step();
+	}
+	return (on*POWER_MAX+ticks/2)/ticks;
+}
+
+static uint16_t delivered(uint16_t demand, uint16_t windows) {
+	return delivered_every(demand, windows, 1);
+}
+
+static void test_average(void) {
+	// Switching only on zero crossings mustn't skew the average, whatever
+	// the demand
+	static const uint16_t demands[] = { 15, 100, 333, 505, 777, 990 };
+	for(uint8_t i=0; i<sizeof(demands)/sizeof(demands[0]); i++) {
+		int16_t got = delivered(demands[i], 100);
+		CHECK(abs(got-demands[i])<=2);
+	}
+	CHECK(delivered(0, 10)==0);
+	// Full power only loses the wait for the very first zero crossing
+	CHECK(delivered(POWER_MAX, 10)>=POWER_MAX-1);
+}
+
+static void test_late_step(void) {
+	// A long control task holds the step up; it has to catch up with the
+	// ticks it missed without losing power or shortening a pulse
+	static const uint16_t demands[] = { 100, 505, 900 };
+	for(uint8_t i=0; i<sizeof(demands)/sizeof(demands[0]); i++) {
+		int16_t got = delivered_every(demands[i], 100, 7);
+		CHECK(abs(got-demands[i])<=5);
+	}
+}
+
+int main(void) {
+	test_average();
+	test_late_step();
+	if(failures) {
+		printf("%d failed\n", failures);
+		return EXIT_FAILURE;
+	}
+	printf("power tests passed\n");
+	return EXIT_SUCCESS;
+}
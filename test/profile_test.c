@@ -0,0 +1,107 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "globals.h"
+#include "pid.h"
+#include "profile.h"
+
+// Host tests for the profile engine. Build and run with "make" in this
+// directory.
+
+#define CHECK(c)	do { if(!(c)) { printf("%s:%d: %s\n", __FILE__, __LINE__, #c); failures++; } } while(0)
+
+static int failures = 0;
+
+static const profseg_t segs[] = {
+	{  60, 150, STAGE_PREHEAT,	0, 0, 0, 0 },
+	{  90, 180, STAGE_SOAK,			0, 0, 0, 0 },
+	{  40, 230, STAGE_RAMPUP,		0, 0, 0, 0 },
+	{  20, 235, STAGE_PEAK,			0, 0, 0, 0 },
+	{  60, 100, STAGE_RAMPDOWN,	0, 0, 0, 0 } };
+static const profdef_t def = { 25, 0, 0, 0, 5, segs, NULL };
+
+// Step the profile with the oven following the setpoint exactly
+static int16_t run_until(profile_t *p, uint8_t stage, uint32_t elapsed) {
+	int16_t sp = TEMP_FX(25);
+	while(!p->done && !(p->cur.stage==stage && p->elapsed>=elapsed))
+		sp = profile_step(p, 50, sp, POWER_MAX/2);
+	return sp;
+}
+
+static void test_resume_rising(void) {
+	profile_t p;
+	profile_load(&p, &def);
+	int16_t sp = run_until(&p, STAGE_RAMPUP, 30000);
+	// The door let 30 degrees out, so the segment winds back to meet the oven
+	profile_resume(&p, sp-TEMP_FX(30));
+	CHECK(p.elapsed<30000);
+	CHECK(profile_step(&p, 50, sp-TEMP_FX(30), 0)<sp);
+}
+
+static void test_resume_rampdown(void) {
+	profile_t p;
+	profile_load(&p, &def);
+	int16_t sp = run_until(&p, STAGE_RAMPDOWN, 30000);
+	uint32_t elapsed = p.elapsed;
+	// Cooling boards must carry on cooling, never go back towards the peak
+	int16_t measured = sp-TEMP_FX(20);
+	profile_resume(&p, measured);
+	CHECK(p.elapsed>=elapsed);
+	for(uint8_t i=0; i<100 && !p.done; i++) {
+		int16_t next = profile_step(&p, 50, measured, 0);
+		CHECK(next<=measured);
+	}
+}
+
+// Slope into and out of a knot, in fixed-point degrees per ms
+static float slope_in(const profile_t *p, uint8_t i) {
+	const segment_t *g = &p->seg[i-1];
+	return (float)(g->c1+2*g->c2+3*g->c3)/g->len;
+}
+
+static float slope_out(const profile_t *p, uint8_t i) {
+	return (float)p->seg[i].c1/p->seg[i].len;
+}
+
+static void test_scale_refit(void) {
+	profile_t p;
+	profile_load(&p, &def);
+	// A heavy load stretches the soak and ramp-up but not the preheat or peak,
+	// and the curve must still be smooth where they meet
+	profile_restore(&p, 1, 0, 0, INT16_MIN, LOAD_SCALE_MAX);
+	for(uint8_t i=1; i<p.count; i++) {
+		float tol = 1.0f/p.seg[i-1].len+1.0f/p.seg[i].len;
+		CHECK(fabsf(slope_in(&p, i)-slope_out(&p, i))<=tol);
+	}
+	// Each rising segment still ends where it did
+	CHECK(p.seg[2].y0==TEMP_FX(180));
+	CHECK(p.seg[1].y0+p.seg[1].c1+p.seg[1].c2+p.seg[1].c3==TEMP_FX(180));
+}
+
+static void test_load_scale_even(void) {
+	profile_t p;
+	profile_load(&p, &def);
+	// An oven rising exactly as fast as the reference per unit of power is
+	// an empty one, whatever the power it's run at
+	float temp = 25;
+	uint16_t demand = POWER_MAX/3;
+	while(p.index==0) {
+		profile_step(&p, 50, TEMP_FX(temp), demand);
+		temp += (p.load_ref/16.0f)*demand/POWER_MAX*50/1000;
+	}
+	CHECK(abs((int)p.load_scale-256)<=2);
+}
+
+int main(void) {
+	test_load_scale_even();
+	test_scale_refit();
+	test_resume_rising();
+	test_resume_rampdown();
+	if(failures) {
+		printf("%d failed\n", failures);
+		return EXIT_FAILURE;
+	}
+	printf("profile tests passed\n");
+	return EXIT_SUCCESS;
+}
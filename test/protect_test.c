@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "globals.h"
+#include "pid.h"
+#include "protect.h"
+
+// Host tests for the heater protection. Build and run with "make" in this
+// directory.
+
+#define CHECK(c)	do { if(!(c)) { printf("%s:%d: %s\n", __FILE__, __LINE__, #c); failures++; } } while(0)
+
+#define DT_MS		10
+
+static int failures = 0;
+
+// Toaster oven: slow to respond, so it keeps rising well after switch-off
+static const ovenmodel_t slow = { 250, 300, 8, TEMP_FX(25) };
+
+// Feed whole seconds of control steps with the temperature moving at a
+// steady rate in degrees per second; returns the temperature reached
+static float feed(protect_t *p, uint16_t secs, float temp, float rate,
+									uint16_t demand, const ovenmodel_t *m) {
+	for(uint32_t i=0; i<(uint32_t)secs*1000/DT_MS; i++) {
+		temp += rate*DT_MS/1000;
+		protect_update(p, TEMP_FX(temp), demand, m);
+	}
+	return temp;
+}
+
+static void test_runaway_idle(void) {
+	protect_t p;
+	protect_init(&p, DT_MS);
+	// Nothing has asked for heat, but the oven climbs a degree a second
+	feed(&p, PROTECT_COAST+PROTECT_WINDOW+1, 25, 1, 0, 0);
+	CHECK(p.fault==PROTECT_RUNAWAY);
+}
+
+static void test_coast_not_runaway(void) {
+	protect_t p;
+	protect_init(&p, DT_MS);
+	float t = feed(&p, 60, 25, 2, POWER_MAX, 0);
+	// Switched off, the oven settles within the coast without a model
+	t = feed(&p, PROTECT_COAST/2, t, 1, 0, 0);
+	feed(&p, 60, t, 0, 0, 0);
+	CHECK(p.fault==PROTECT_OK);
+}
+
+static void test_slow_model_coast(void) {
+	protect_t p;
+	protect_init(&p, DT_MS);
+	float t = feed(&p, 60, 25, 1, POWER_MAX, &slow);
+	// Three dead times of coasting is more than the no-model coast, and
+	// mustn't read as a runaway
+	t = feed(&p, 3*slow.deadtime, t, 0.8f, 0, &slow);
+	CHECK(p.fault==PROTECT_OK);
+	feed(&p, 60, t, 0, 0, &slow);
+	CHECK(p.fault==PROTECT_OK);
+	
+	// Still rising that fast once the coast is over is a runaway
+	protect_reset(&p);
+	feed(&p, 3*slow.deadtime+PROTECT_WINDOW+1, t, 0.8f, 0, &slow);
+	CHECK(p.fault==PROTECT_RUNAWAY);
+}
+
+static void test_ineffective(void) {
+	protect_t p;
+	protect_init(&p, DT_MS);
+	// Full power with the temperature going nowhere
+	feed(&p, PROTECT_COAST+PROTECT_WINDOW+1, 25, 0, POWER_MAX, 0);
+	CHECK(p.fault==PROTECT_INEFFECTIVE);
+	
+	// A slow oven takes its dead time to start rising from cold
+	protect_init(&p, DT_MS);
+	float t = feed(&p, 3*slow.deadtime-1, 25, 0, POWER_MAX, &slow);
+	feed(&p, 60, t, 0.5f, POWER_MAX, &slow);
+	CHECK(p.fault==PROTECT_OK);
+}
+
+static void test_latched(void) {
+	protect_t p;
+	protect_init(&p, DT_MS);
+	feed(&p, PROTECT_COAST+PROTECT_WINDOW+1, 25, 1, 0, 0);
+	// Cooling off again doesn't clear it
+	feed(&p, 60, 25, -1, 0, 0);
+	CHECK(p.fault==PROTECT_RUNAWAY);
+}
+
+int main(void) {
+	test_runaway_idle();
+	test_coast_not_runaway();
+	test_slow_model_coast();
+	test_ineffective();
+	test_latched();
+	if(failures) {
+		printf("%d failed\n", failures);
+		return EXIT_FAILURE;
+	}
+	printf("protect tests passed\n");
+	return EXIT_SUCCESS;
+}
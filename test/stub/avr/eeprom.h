@@ -0,0 +1,21 @@
+/* Host stand-in for avr-libc's EEPROM access, for the unit tests. The test
+   defines eeprom_image, addresses index into it. */
+#ifndef EEPROM_STUB_H
+#define EEPROM_STUB_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define EEPROM_STUB_SIZE		1024
+extern uint8_t eeprom_image[EEPROM_STUB_SIZE];
+
+#define EEPROM_STUB_AT(a)		(&eeprom_image[(uintptr_t)(a)])
+
+static inline uint8_t eeprom_read_byte(const uint8_t *a) { return *EEPROM_STUB_AT(a); }
+static inline void eeprom_update_byte(uint8_t *a, uint8_t v) { *EEPROM_STUB_AT(a) = v; }
+static inline void eeprom_write_byte(uint8_t *a, uint8_t v) { *EEPROM_STUB_AT(a) = v; }
+static inline void eeprom_read_block(void *d, const void *a, size_t n) { memcpy(d, EEPROM_STUB_AT(a), n); }
+static inline void eeprom_update_block(const void *s, void *a, size_t n) { memcpy(EEPROM_STUB_AT(a), s, n); }
+static inline void eeprom_write_block(const void *s, void *a, size_t n) { memcpy(EEPROM_STUB_AT(a), s, n); }
+
+#endif // EEPROM_STUB_H
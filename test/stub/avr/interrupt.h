@@ -0,0 +1,8 @@
+/* Host stand-in for avr-libc's interrupt control; the tests run single-threaded */
+#ifndef INTERRUPT_STUB_H
+#define INTERRUPT_STUB_H
+
+#define cli()
+#define sei()
+
+#endif
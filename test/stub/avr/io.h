@@ -0,0 +1,9 @@
+/* Host stand-in for the avr-libc registers the modules under test touch */
+#ifndef IO_STUB_H
+#define IO_STUB_H
+
+#include <stdint.h>
+
+static volatile uint8_t SREG __attribute__((unused));
+
+#endif
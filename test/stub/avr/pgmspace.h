@@ -0,0 +1,16 @@
+/* Host stand-in for avr-libc's program memory access, for the unit tests */
+#ifndef PGMSPACE_STUB_H
+#define PGMSPACE_STUB_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PGM_P								const char *
+#define PSTR(s)							(s)
+#define pgm_read_byte(a)		(*(const uint8_t*)(a))
+#define pgm_read_word(a)		(*(const uint16_t*)(a))
+#define memcpy_P						memcpy
+#define strcpy_P						strcpy
+
+#endif // PGMSPACE_STUB_H
@@ -0,0 +1,74 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "supply.h"
+
+// Host tests for the supply compensation. Build and run with "make" in this
+// directory.
+
+#define CHECK(c)	do { if(!(c)) { printf("%s:%d: %s\n", __FILE__, __LINE__, #c); failures++; } } while(0)
+
+static int failures = 0;
+
+// Q4 reading of a 2V thermocouple output against a given supply
+static uint16_t reading(uint16_t mv) {
+	return (uint32_t)2000*1024*16/mv;
+}
+
+// Feed bandgap readings for a supply; returns the readings taken to get
+// within 1% of the nominal reading
+static uint16_t settle(supply_t *s, uint16_t mv, uint16_t n) {
+	uint16_t took = 0;
+	for(uint16_t i=1; i<=n; i++) {
+		supply_sample(s, SUPPLY_BANDGAP(mv));
+		int16_t err = supply_correct(s, reading(mv))-reading(SUPPLY_NOMINAL_MV);
+		if(abs(err)*100>reading(SUPPLY_NOMINAL_MV)) took = 0;
+		else if(!took) took = i;
+	}
+	return took;
+}
+
+static void test_nominal(void) {
+	// At the nominal supply nothing changes
+	supply_t s;
+	supply_init(&s);
+	settle(&s, SUPPLY_NOMINAL_MV, 100);
+	CHECK(abs(supply_correct(&s, reading(SUPPLY_NOMINAL_MV))-reading(SUPPLY_NOMINAL_MV))<=16);
+}
+
+static void test_step(void) {
+	// A sagging or high supply is followed within a few tens of readings
+	static const uint16_t mv[] = { 4500, 4750, 5250 };
+	for(uint8_t i=0; i<sizeof(mv)/sizeof(mv[0]); i++) {
+		supply_t s;
+		supply_init(&s);
+		uint16_t took = settle(&s, mv[i], 200);
+		CHECK(took && took<=30);
+	}
+}
+
+static void test_out_of_range(void) {
+	// A bandgap reading no real supply could give is ignored
+	supply_t s;
+	supply_init(&s);
+	uint16_t gain = s.gain;
+	supply_sample(&s, SUPPLY_BANDGAP(SUPPLY_MIN_MV)+5);
+	supply_sample(&s, SUPPLY_BANDGAP(SUPPLY_MAX_MV)-5);
+	CHECK(s.gain==gain);
+	
+	// A high supply scales readings up, but not past the top
+	settle(&s, SUPPLY_MAX_MV, 100);
+	CHECK(supply_correct(&s, 0xFFF0)==UINT16_MAX);
+}
+
+int main(void) {
+	test_nominal();
+	test_step();
+	test_out_of_range();
+	if(failures) {
+		printf("%d failed\n", failures);
+		return EXIT_FAILURE;
+	}
+	printf("supply tests passed\n");
+	return EXIT_SUCCESS;
+}
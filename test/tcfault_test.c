@@ -0,0 +1,100 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "tcfault.h"
+
+// Host tests for the thermocouple fault classification. Build and run with
+// "make" in this directory.
+
+#define CHECK(c)	do { if(!(c)) { printf("%s:%d: %s\n", __FILE__, __LINE__, #c); failures++; } } while(0)
+
+static int failures = 0;
+
+static void test_clean(void) {
+	// A real heating ramp with a count of noise raises nothing
+	tcfault_t t;
+	tcf_reset(&t);
+	for(uint16_t i=0; i<4000; i++)
+		CHECK(tcf_sample(&t, 200+i/8+(i&1))==0);
+}
+
+static void test_rail(void) {
+	// Pinned to either rail is a fault, but only once it stays there
+	for(uint8_t r=0; r<2; r++) {
+		tcfault_t t;
+		tcf_reset(&t);
+		for(uint8_t i=0; i<10; i++) tcf_sample(&t, 300);
+		uint16_t rail = r?1023:0;
+		for(uint8_t i=1; i<=TCF_RAIL_SAMPLES; i++) {
+			uint8_t flags = tcf_sample(&t, rail);
+			CHECK(!(flags&TCF_FAULT)==(i<TCF_RAIL_SAMPLES));
+		}
+	}
+}
+
+static void test_glitch(void) {
+	// A lone spike is left out of the average without calling the sensor
+	// flaky, and the reading after it is taken as normal
+	tcfault_t t;
+	tcf_reset(&t);
+	for(uint8_t i=0; i<10; i++) tcf_sample(&t, 300);
+	CHECK(tcf_sample(&t, 400)==TCF_GLITCH);
+	CHECK(tcf_sample(&t, 300)==0);
+}
+
+static void test_new_level(void) {
+	// A lasting jump is accepted after a few samples rather than rejected
+	// for ever
+	tcfault_t t;
+	tcf_reset(&t);
+	for(uint8_t i=0; i<10; i++) tcf_sample(&t, 300);
+	for(uint8_t i=1; i<TCF_REPRIME; i++) CHECK(tcf_sample(&t, 350)&TCF_GLITCH);
+	CHECK(!(tcf_sample(&t, 350)&TCF_GLITCH));
+	CHECK(tcf_sample(&t, 350)==0);
+}
+
+static void test_intermittent(void) {
+	// A loose connection is flagged flaky first, then failed, and a sensor
+	// that settles down again is cleared
+	tcfault_t t;
+	tcf_reset(&t);
+	uint16_t flaky_at = 0, fault_at = 0;
+	for(uint16_t i=1; i<=500 && !fault_at; i++) {
+		uint8_t flags = tcf_sample(&t, (i%5)?300:500);
+		if((flags&TCF_FLAKY) && !flaky_at) flaky_at = i;
+		if(flags&TCF_FAULT) fault_at = i;
+	}
+	CHECK(flaky_at && fault_at && flaky_at<fault_at);
+	
+	tcf_reset(&t);
+	for(uint16_t i=1; i<=100; i++) tcf_sample(&t, (i%5)?300:500);
+	CHECK(tcf_sample(&t, 300)&TCF_FLAKY);
+	uint8_t flags = 0;
+	for(uint16_t i=0; i<300; i++) flags = tcf_sample(&t, 300);
+	CHECK(flags==0);
+}
+
+static void test_noisy(void) {
+	// Steps each small enough to believe, but far too many of them
+	tcfault_t t;
+	tcf_reset(&t);
+	uint8_t flags = 0;
+	for(uint16_t i=0; i<500; i++) flags |= tcf_sample(&t, (i&1)?300:308);
+	CHECK(flags&TCF_FLAKY);
+	CHECK(!(flags&TCF_GLITCH));
+}
+
+int main(void) {
+	test_clean();
+	test_rail();
+	test_glitch();
+	test_new_level();
+	test_intermittent();
+	test_noisy();
+	if(failures) {
+		printf("%d failed\n", failures);
+		return EXIT_FAILURE;
+	}
+	printf("tcfault tests passed\n");
+	return EXIT_SUCCESS;
+}